@@ -35,45 +35,142 @@
 #include <stdbool.h>
 #include "chip.h"
 #include "adc.h"
+#include "idle.h"
 #include "uart.h"
 
 unsigned char __xdata board_id;
 unsigned char __xdata adc_cache[4]; /* 3 */
+unsigned int __xdata adc_value[4];
+unsigned char __xdata adc_samples[4];
+volatile unsigned char __data adc_events;
 
-static __bit adc_interrupt_flag_remove_me;
+static struct adc_window_type __xdata adc_window[ADC_CHANNELS];
 
+static unsigned char __code adc_channel_mask[4] = { 0x01, 0x02, 0x04, 0x08 };
 
-//! store the result and select next channel
+static unsigned int __xdata adc_accu;
+static unsigned char __xdata adc_count;
+
+
+//! accumulate the result and select next conversion
 /*! Wait for someone else to start ADC conversion.
-    Actually temperature sensor and board ID will
-    be quite boring.
-    If we read out the temperature sensor say ten
-    times quicker than its time constant then this
-    likely is more than enough.
+    Then each channel is converted ADC_OVERSAMPLE times back
+    to back (the IRQ restarts the conversion, so the samples are
+    equally spaced by the conversion time) and the sum is stored
+    in adc_value[]. This gives 10 effective bits if there is
+    a bit of noise on the input, and it averages out noise
+    that is there anyway.
+    A sum outside the window of its channel sets the channel's bit
+    in adc_events and wakes the main loop, any other sum does not.
+    After the last channel the ADC stays idle until it is
+    started again (once per second by the timer IRQ).
 
     How many uJ does a conversion take?^)
  */
 void adc_interrupt(void) __interrupt(0x1f)
 {
-    unsigned char t,d;
+    unsigned char t,c;
+
+    t = ADCTRL & 0x0c;
+    c = t >> 2;
+    adc_accu += ADCDAT;
+
+    if( ++adc_count < ADC_OVERSAMPLE )
+    {
+        ADCTRL = t | 0x01;      /**< same channel again */
+    }
+    else
+    {
+        adc_value[c] = adc_accu;
+        adc_cache[c] = (adc_accu + ADC_OVERSAMPLE / 2) >> ADC_OVERSAMPLE_SHIFT;
+        adc_samples[c]++;
+        if( adc_accu < adc_window[c].lo || adc_accu > adc_window[c].hi )
+        {
+            adc_events |= adc_channel_mask[c];
+            busy = 1;
+        }
+        adc_accu = 0;
+        adc_count = 0;
 
-    d = ADCDAT;
-    t = ADCTRL;
-    adc_cache[(t>>2) & 0x03] = d;
-    t = t + 0x04;               /**< switch to next channel */
-    if( t >= (3 * 0x04) )       /**< allow 3 channels */
-        t = 0;
-    ADCTRL = t;
+        t = t + 0x04;           /**< switch to next channel */
+        if( t >= (ADC_CHANNELS * 0x04) )
+            ADCTRL = 0;         /**< round complete */
+        else
+            ADCTRL = t | 0x01;
+    }
 
    /* Reset pending flag */
     P3IF &= ~0x80;
+}
 
-    adc_interrupt_flag_remove_me = 1;
+
+//! the sum of the last ADC_OVERSAMPLE conversions of a channel
+/*! reading a 16 bit value updated by IRQ */
+unsigned int adc_get(unsigned char channel)
+{
+    unsigned int v;
+
+    P3IE &= ~0x80;
+    v = adc_value[channel];
+    P3IE |= 0x80;
+
+    return v;
+}
+
+
+//! post an event if the channel leaves lo..hi (12 bit sum)
+/*! Clears a pending event of the channel. A sum already outside
+    the window posts an event with the next round of conversions.
+    Use lo = 0, hi = 0xffff for no events.
+ */
+void adc_set_window(unsigned char channel, unsigned int lo, unsigned int hi)
+{
+    P3IE &= ~0x80;
+    adc_window[channel].lo = lo;
+    adc_window[channel].hi = hi;
+    adc_events &= ~adc_channel_mask[channel];
+    P3IE |= 0x80;
+}
+
+
+//! test and clear the event of a channel
+/*! The window stays as it is, so set a new one
+    or the next round of conversions will post again */
+bool adc_event(unsigned char channel)
+{
+    unsigned char mask = adc_channel_mask[channel];
+
+    if( !(adc_events & mask) )
+        return 0;
+
+    adc_events &= ~mask;
+    return 1;
+}
+
+
+//! 12 bit sum of ADC_CHANNEL_EXT_VOLTAGE to mV
+unsigned int adc_to_ext_mV(unsigned int v)
+{
+    return (unsigned long)v * ADC_EXT_VOLTAGE_FULL_SCALE_mV / (ADC_OVERSAMPLE * 256);
+}
+
+
+//! mV to the lowest 12 bit sum that is at least mV
+unsigned int adc_from_ext_mV(unsigned int mV)
+{
+    return ((unsigned long)mV * (ADC_OVERSAMPLE * 256) + ADC_EXT_VOLTAGE_FULL_SCALE_mV - 1) /
+           ADC_EXT_VOLTAGE_FULL_SCALE_mV;
 }
 
 
 void adc_init(void)
 {
+    unsigned char i;
+
+    /* no events until someone is interested */
+    for( i = 0; i < ADC_CHANNELS; i++ )
+        adc_set_window( i, 0x0000, 0xffff );
+
     /* enable selected channels */
     ADDAEN = 0x07;
 
@@ -135,7 +232,7 @@ void get_board_id(void)
 
     for( i = 0; i != 0x3fff; i++ )
     {
-        if( adc_interrupt_flag_remove_me )
+        if( adc_samples[1] )
             break;
     }
 
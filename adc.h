@@ -24,13 +24,48 @@
 
 #define ADC_START_CONVERSION do{ ADCTRL |= 0x01; } while(0)
 
+//! number of conversions summed up per channel (power of 2)
+#define ADC_OVERSAMPLE_SHIFT (4)
+#define ADC_OVERSAMPLE (1 << ADC_OVERSAMPLE_SHIFT)
+
+//! number of channels converted in a round
+#define ADC_CHANNELS (3)
+
+#define ADC_CHANNEL_TEMPERATURE (0)     /**< NTC for the ambient temperature */
+#define ADC_CHANNEL_BOARD_ID    (1)
+#define ADC_CHANNEL_EXT_VOLTAGE (2)     /**< unconfirmed */
+
+//! external voltage at full scale of the ADC
+#define ADC_EXT_VOLTAGE_FULL_SCALE_mV (20000uL)  /**< fix, divider on the board unknown */
+
+//! adc_value[] of a channel within lo..hi does not post an event
+struct adc_window_type {
+    unsigned int lo;
+    unsigned int hi;
+};
+
+//! 8 bit result per channel (rounded from adc_value)
 extern unsigned char __xdata adc_cache[4];
+//! sum of ADC_OVERSAMPLE conversions per channel (12 bit)
+/*! Use adc_get() from the main loop, it is a 16 bit value. */
+extern unsigned int __xdata adc_value[4];
+//! incremented whenever adc_value[] of a channel is updated
+extern unsigned char __xdata adc_samples[4];
+//! bit n is set by IRQ if adc_value[n] was outside its window
+extern volatile unsigned char __data adc_events;
 extern unsigned char __xdata board_id;
 
 void adc_interrupt(void) __interrupt(0x1f);
 
 void adc_init(void);
 
+unsigned int adc_get(unsigned char channel);
+void adc_set_window(unsigned char channel, unsigned int lo, unsigned int hi);
+bool adc_event(unsigned char channel);
+
+unsigned int adc_to_ext_mV(unsigned int v);
+unsigned int adc_from_ext_mV(unsigned int mV);
+
 void get_board_id(void);
 
 unsigned char __code * board_id_to_string(void);
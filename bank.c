@@ -0,0 +1,137 @@
+/*-------------------------------------------------------------------------
+   bank.c - banked code on the EC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+/*! Code that is not timing critical (monitor, register dumps,
+    manufacturing data) is declared __banked and compiled into the
+    code segments BANK0 and BANK1 (see Makefile). The upper 16 bits
+    of the link address are the bank number SDCC passes in r2.
+
+    A bank is mapped into the CPU address range 0x8000..0xbfff by
+    XBISEG2 (the same remapping failsafe.c uses to relocate the image).
+    Bank n is taken from segment 2 of the 64k page following the
+    running page by n:
+    - bank 0 is 0x8000..0xbfff of the running image itself (BANK0 is
+      linked to 0x8001, behind the cookie of build.c),
+    - bank 1 is the 16k image $(PROJECT).bank1.bin which has to be
+      flashed to 0x8000 of the page after the running page (BANK1 is
+      linked to 0x18000).
+
+    Home code (everything not __banked, including all IRQ routines and
+    this file) lives in 0x0000..0x7fff (--code-size in the Makefile)
+    and in HOME2 at 0xc001..0xf2ff, below the strings of build.c.
+    Interrupt routines must not touch XBISEG2.
+
+    That gives 0x8000 + 0x3400 (incl. 0xf300..0xf3ff) bytes of home
+    code and 16k each for bank 0 and banks 1..BANKS, 78848 bytes
+    with BANKS 1.
+    flash_prog.c refuses to erase or program the pages holding banks.
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "bank.h"
+#include "flash.h"
+
+#if defined(BANK1_LOC) && (BANK1_LOC != BANK_LOC(BANKS))
+#error BANK1 is not linked to the last bank of BANKS (see Makefile, bank.h)
+#endif
+
+//! XBISEG2 setting for bank 0
+unsigned char __data bank_base;
+
+//! has to be called before the first call to a __banked function
+void bank_init(void)
+{
+    bank_base = 0x80 | (flash_running_page() << 2) | (BANK_WINDOW / 0x4000);
+    XBISEG2 = bank_base;
+}
+
+
+#if defined(SDCC)
+
+//! called by SDCC instead of lcall for __banked functions
+/*! r0/r1 hold the target address, r2 the bank, dpl/dph/b/a
+    the arguments (must be preserved).
+    Assumes register bank 0 (main loop context).
+ */
+void bank_call(void) __naked
+{
+    __asm
+    __sdcc_banked_call::
+        push    dpl
+        push    dph
+        push    acc
+
+        mov     dptr,#_XBISEG2
+        movx    a,@dptr         ; current mapping (restored on return)
+        xch     a,r2            ; r2 = current mapping, a = new bank
+        anl     a,#0x0f
+        rl      a
+        rl      a
+        add     a,_bank_base
+        movx    @dptr,a         ; switch the window
+
+        pop     acc
+        pop     dph
+        pop     dpl
+
+        push    ar2             ; picked up by __sdcc_banked_ret
+        push    ar0             ; target address
+        push    ar1
+        ret                     ; and call
+    __endasm;
+}
+
+//! banked functions ljmp here instead of ret
+/*! Return value is in dpl/dph/b/a, r0..r2 are free. */
+void bank_ret(void) __naked
+{
+    __asm
+    __sdcc_banked_ret::
+        mov     r0,a
+        mov     r1,dpl
+        mov     r2,dph
+
+        pop     acc             ; mapping of the caller
+        mov     dptr,#_XBISEG2
+        movx    @dptr,a
+
+        mov     dpl,r1
+        mov     dph,r2
+        mov     a,r0
+        ret
+    __endasm;
+}
+
+#endif
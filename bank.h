@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+   bank.h - banked code on the EC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+//! code segment (16k) the banked code is mapped into by XBISEG2
+#define BANK_WINDOW (0x8000)
+
+//! banks beyond bank 0, bank n is in the n-th page after the running page
+#define BANKS (1)
+
+//! link address of bank n (BANKn_LOC in the Makefile)
+#define BANK_LOC(n) (0x10000UL * (n) + BANK_WINDOW)
+
+void bank_init(void);
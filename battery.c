@@ -39,10 +39,14 @@
  */
 #include <stdbool.h>
 #include "chip.h"
+#include "adc.h"
 #include "battery.h"
+#include "charge_sched.h"
 #include "one_wire.h"
 #include "timer.h"
+#include "trace.h"
 #include "states.h"
+#include "temperature.h"
 
 #define EXT_VOLTAGE_OK_FOR_CHARGING_mV (9600) /* fix */
 #define EXT_VOLTAGE_OK_FOR_CHARGING_FROM_Pb_mV (11890+100) /* fix.. 11890mV is probably 0% */
@@ -60,6 +64,26 @@
 
 #define PWM_MAX (0xfe)
 
+//! external voltage must exceed the "OK" level by this before the PWM may increase
+#define EXT_VOLTAGE_HYSTERESIS_mV (150)
+
+//! no charging while the ambient temperature (EC board NTC) is above this
+#define AMBIENT_MAX_FOR_CHARGING_cC (4500)  /* fix */
+#define AMBIENT_HYSTERESIS_cC (200)
+
+//! constant voltage phase regulates to the table's upper U_mV limit minus this
+#define CHARGE_CV_MARGIN_mV (30)
+
+//! PI gains. Fixed point 8.8: PWM steps per mA of current error (per sample)
+#define CHARGE_KP (16)
+#define CHARGE_KI (8)
+
+//! mA of current error per mV of voltage error in the CV phase
+#define CHARGE_CV_GAIN (4)
+
+//! limit of the (current equivalent) error fed to the regulator
+#define CHARGE_ERROR_MAX_mA (2000)
+
 #define BATTERY_COMPARE_NUM (8)
 
 //! High level view of battery
@@ -82,11 +106,179 @@ struct {
       } __xdata power_supply;
 
 
-//! fake register
+//! output of the charge regulator
+/*! Not applied to a pin. The PWM outputs are on GPIO06..0a (TX, RX,
+    EC_EAPD, LED_PWR#, LED_CHG_R#, see sfr_dump.c), none of them
+    reaches the charger which is switched by CHG, CC0 and CV_SET. */
 volatile unsigned char __xdata pwm1;
-//! should be from ADC
+//! from ADC, updated only when it crosses a threshold of the charge logic
 volatile unsigned int __xdata ext_voltage;
 
+//! ok_mV the ext_voltage window is set up for, 0xffff forces a new setup
+static unsigned int __xdata ext_window_ok_mV;
+
+//! ambient too hot to charge (with hysteresis)
+static bool ambient_hot;
+
+enum {
+      CHARGE_SUPPLY_OK,     /**< PWM may increase */
+      CHARGE_SUPPLY_HOLD,   /**< supply within hysteresis band, do not increase */
+      CHARGE_SUPPLY_DOWN    /**< supply too low, ramp down */
+     };
+
+static unsigned char __pdata charge_supply_limit;
+
+//! output of the regulator, pwm1 follows it rate limited
+static unsigned char __pdata charge_pwm_target;
+
+static unsigned int __xdata charge_setpoint_mA;
+static unsigned int __xdata charge_limit_mV;
+
+//! integrator of the PI regulator. 8.8 fixed point PWM value
+static long __xdata charge_integ;
+
+
+static void charge_pwm_write(unsigned char duty)
+{
+    pwm1 = duty;
+}
+
+
+void charge_pwm_init(void)
+{
+    charge_pwm_write(0);
+}
+
+
+//! selects the charge current (and voltage limit). cur 0 switches off
+/*! \param cur      charge current in units of 10 mA
+                    (as in battery_compare_type.charging)
+    \param limit_mV voltage for the constant voltage phase
+                    (0 for no limit). The regulator stays
+                    CHARGE_CV_MARGIN_mV below it.
+ */
+void set_charge_mode( unsigned char cur, unsigned int limit_mV )
+{
+    charge_setpoint_mA = cur * 10u;
+    charge_limit_mV = limit_mV;
+    battery.may_charge = (cur != 0);
+
+    if( !cur )
+    {
+        /* no ramping down here */
+        charge_integ = 0;
+        charge_pwm_target = 0;
+        charge_pwm_write(0);
+    }
+}
+
+
+//! PI regulator, to be called once for every new sample in compare_is
+/*! Current regulation with a voltage limit (CC/CV).
+    Anti-windup: the integrator is clamped to the PWM range and
+    does not integrate into a limit (PWM at 0 or PWM_MAX or
+    supply not allowing an increase).
+    The output is charge_pwm_target, handle_battery() moves
+    pwm1 towards it rate limited.
+ */
+void charge_regulator_update(void)
+{
+    int e;
+    long out;
+
+    if( !charge_setpoint_mA )
+        return;
+
+    /* charging current is positive */
+    e = charge_setpoint_mA - compare_is.I_mA;
+
+    if( charge_limit_mV )
+    {
+        int ev = charge_limit_mV - CHARGE_CV_MARGIN_mV - compare_is.U_mV;
+
+        if( ev > CHARGE_ERROR_MAX_mA / CHARGE_CV_GAIN )
+            ev = CHARGE_ERROR_MAX_mA / CHARGE_CV_GAIN;
+        else if( ev < -CHARGE_ERROR_MAX_mA / CHARGE_CV_GAIN )
+            ev = -CHARGE_ERROR_MAX_mA / CHARGE_CV_GAIN;
+        ev *= CHARGE_CV_GAIN;
+
+        if( ev < e )
+            e = ev;
+    }
+
+    if( e > CHARGE_ERROR_MAX_mA )
+        e = CHARGE_ERROR_MAX_mA;
+    else if( e < -CHARGE_ERROR_MAX_mA )
+        e = -CHARGE_ERROR_MAX_mA;
+
+    if( (e > 0 && charge_supply_limit == CHARGE_SUPPLY_OK && pwm1 < PWM_MAX) ||
+        (e < 0 && pwm1 > 0) )
+    {
+        charge_integ += e * CHARGE_KI;
+
+        if( charge_integ < 0 )
+            charge_integ = 0;
+        else if( charge_integ > ((long)PWM_MAX << 8) )
+            charge_integ = (long)PWM_MAX << 8;
+    }
+
+    out = charge_integ + (long)e * CHARGE_KP;
+
+    if( out < 0 )
+        charge_pwm_target = 0;
+    else if( out > ((long)PWM_MAX << 8) )
+        charge_pwm_target = PWM_MAX;
+    else
+        charge_pwm_target = (unsigned char)(out >> 8);
+}
+
+
+//! moves pwm1 towards charge_pwm_target. Slowly up, faster down
+static void charge_pwm_rate_limit(void)
+{
+    unsigned char p = pwm1;
+
+    if( charge_supply_limit == CHARGE_SUPPLY_DOWN )
+    {
+        /* ramp down and let the integrator follow
+           so it does not push back once the supply recovered */
+        p = (p > 2) ? p - 2 : 0;
+        charge_integ = (long)p << 8;
+    }
+    else if( p < charge_pwm_target )
+    {
+        if( charge_supply_limit == CHARGE_SUPPLY_OK )
+            p++;
+    }
+    else if( p > charge_pwm_target )
+    {
+        p--;
+        if( p > charge_pwm_target )
+            p--;
+    }
+
+    if( p != pwm1 )
+        charge_pwm_write(p);
+}
+
+
+
+//! reevaluate the ambient temperature limit and set the next ADC window
+/*! The main loop only hears from the ADC when the temperature
+    crosses the limit that is not yet crossed. */
+static void ambient_check(void)
+{
+    unsigned int hot = adc_from_centi_degC( AMBIENT_MAX_FOR_CHARGING_cC );
+    unsigned int cool = adc_from_centi_degC( AMBIENT_MAX_FOR_CHARGING_cC - AMBIENT_HYSTERESIS_cC );
+
+    /* the ADC value falls with rising temperature */
+    ambient_hot = adc_get( ADC_CHANNEL_TEMPERATURE ) < (ambient_hot ? cool : hot);
+
+    if( ambient_hot )
+        adc_set_window( ADC_CHANNEL_TEMPERATURE, 0x0000, cool - 1 );
+    else
+        adc_set_window( ADC_CHANNEL_TEMPERATURE, hot, 0xffff );
+}
 
 
 //! the state machine that handles the battery.
@@ -124,9 +316,16 @@ bool handle_battery(void)
         return 0;
     my_tick = (unsigned char) tick;
 
+    if( adc_event( ADC_CHANNEL_TEMPERATURE ) )
+        ambient_check();
+
     switch(state){
 
         case bat_init:
+            charge_pwm_target = 0;
+            charge_supply_limit = CHARGE_SUPPLY_OK;
+            ext_window_ok_mV = 0xffff;
+            ambient_check();
             state = bat_get_info;
             break;
 
@@ -146,8 +345,12 @@ bool handle_battery(void)
         case bat_charge:
         case bat_ramp_up_charge_current:
 
-
-            if( battery.charge_mAs >= (bat_chem_LiFe ?
+            if( !battery.may_charge || ambient_hot )
+            {
+                charge_pwm_target = 0;
+                state = bat_init;
+            }
+            else if( battery.charge_mAs >= (bat_chem_LiFe ?
                                        (unsigned long)MAX_NOMINAL_CAPACITY_FOR_LiFe_mAs :
                                        MAX_NOMINAL_CAPACITY_FOR_NiMH_mAs))
             {
@@ -167,54 +370,66 @@ bool handle_battery(void)
                    A negative input resistance is a fine ingredient for an
                    oscillator. We don't want an oscillator and much less
                    we want a class room of them =:)
+
+                   So the regulator output is only allowed to increase
+                   if the supply has some headroom (hysteresis band),
+                   is held within the band and is ramped down below it.
+                   The regulator does not integrate while the supply
+                   limits it.
                    */
+                unsigned int ok_mV;
+
                 switch(power_supply.ps_type)
                 {
                     case PS_TYPE_WALL_ADAPTER:
                          /* no fuzzing around, gimme what I want */
-                         pwm1 = PWM_MAX;
+                         ok_mV = 0;
                          break;
 
                     case PS_TYPE_Pb:    /* should be very scrupulous to avoid
                                            deep cycling Pb. */
-                        if (ext_voltage >= EXT_VOLTAGE_OK_FOR_CHARGING_FROM_Pb_mV)
-                        {
-                          /* relatively slow ramp up */
-                          if( pwm1 <= PWM_MAX )
-                              pwm1++;
-                        }
-                        else
-                        {
-                           if( pwm1 )
-                               pwm1--;
-                           /* ramp down more quickly */
-                           if( pwm1 )
-                               pwm1--;
-                        }
+                        ok_mV = EXT_VOLTAGE_OK_FOR_CHARGING_FROM_Pb_mV;
                         break;
 
                     case PS_TYPE_SOLAR: /* should try to optimize efficiency
                                            of the solar panel */
                     case PS_TYPE_UNKNOWN:
                     default:
-                        if (ext_voltage >= EXT_VOLTAGE_OK_FOR_CHARGING_mV)
-                        {
-                           /* relatively slow ramp up */
-                           if( pwm1 <= PWM_MAX )
-                              pwm1++;
-                        }
-                        else
-                        {
-                           if( pwm1 )
-                               pwm1--;
-                           /* ramp down more quickly */
-                           if( pwm1 )
-                               pwm1--;
-                           if( power_supply.unstable != 0xff )
-                               power_supply.unstable++;
-                        }
+                        ok_mV = EXT_VOLTAGE_OK_FOR_CHARGING_mV;
                         break;
-                  }
+                }
+
+                /* only reevaluated if the ADC saw a threshold crossed.
+                   The window is the band ext_voltage is in. */
+                if( ok_mV != ext_window_ok_mV ||
+                    adc_event( ADC_CHANNEL_EXT_VOLTAGE ) )
+                {
+                    unsigned int ok = adc_from_ext_mV( ok_mV );
+                    unsigned int ok_hyst = adc_from_ext_mV( ok_mV + EXT_VOLTAGE_HYSTERESIS_mV );
+
+                    ext_window_ok_mV = ok_mV;
+                    ext_voltage = adc_to_ext_mV( adc_get( ADC_CHANNEL_EXT_VOLTAGE ) );
+
+                    if( ext_voltage < ok_mV )
+                    {
+                        charge_supply_limit = CHARGE_SUPPLY_DOWN;
+                        if( power_supply.unstable != 0xff )
+                            power_supply.unstable++;
+                        adc_set_window( ADC_CHANNEL_EXT_VOLTAGE, 0x0000, ok - 1 );
+                    }
+                    else if( ok_mV && ext_voltage < ok_mV + EXT_VOLTAGE_HYSTERESIS_mV )
+                    {
+                        charge_supply_limit = CHARGE_SUPPLY_HOLD;
+                        adc_set_window( ADC_CHANNEL_EXT_VOLTAGE, ok, ok_hyst - 1 );
+                    }
+                    else
+                    {
+                        charge_supply_limit = CHARGE_SUPPLY_OK;
+                        adc_set_window( ADC_CHANNEL_EXT_VOLTAGE, ok_mV ? ok_hyst : 0x0000, 0xffff );
+                    }
+                }
+
+                state = bat_charge;
             }
             break;
 
@@ -224,6 +439,8 @@ bool handle_battery(void)
 
     }
 
+    charge_pwm_rate_limit();
+
     if( battery.voltage_mV <= (bat_chem_LiFe ?
                                  VOLTAGE_MIN_FOR_LiFe_mV :
                                  VOLTAGE_MIN_FOR_NiMH_mV))
@@ -237,8 +454,132 @@ bool handle_battery(void)
 
     /* for debugging */
     STATES_UPDATE(battery, state);
+    trace_state(TRACE_BATTERY, state);
 
     /* the only exit of this function, exept the one on top? */
     return 0;
 }
 
+
+//! time constant of the derivative estimators is 2^n samples (about 64 s)
+#define DERIVATIVE_EMA_SHIFT (6)
+
+//! samples needed before the derivatives are reported
+#define DERIVATIVE_WARMUP (1 << DERIVATIVE_EMA_SHIFT)
+
+//! a gap in the samples this long restarts the estimators
+#define DERIVATIVE_MAX_GAP_ms (10000ul)
+
+//! state of the derivative estimators
+/*! Both the changes of the quantity (sx) and the time between
+    the samples (st) are filtered by the same exponential moving
+    average. The slope is sx/st so irregular sample intervals
+    are weighted correctly. sx carries 8 fractional bits.
+    No allocation, no division except when the slope is read out.
+ */
+static struct {
+    int32_t sx_U;
+    int32_t sx_T;
+    uint32_t st;
+    uint16_t last_U_mV;
+     int16_t last_T_cCelsius;
+    uint32_t last_t_ms;
+    unsigned char samples;
+} __xdata deriv;
+
+
+void battery_derivatives_init(void)
+{
+    deriv.sx_U = 0;
+    deriv.sx_T = 0;
+    deriv.st = 0;
+    deriv.samples = 0;
+}
+
+
+//! sx * num / (st * den) with 8 fractional bits of sx removed, saturated to int16
+/*! sx is split into quotient and remainder so that the
+    intermediate results stay within 32 bit. */
+static int16_t ema_slope(int32_t sx, uint32_t st, uint16_t num, uint16_t den)
+{
+    uint32_t ax;
+    uint32_t q;
+    uint32_t r;
+    bool neg = 0;
+
+    if( !st )
+        return 0;
+
+    if( sx < 0 )
+    {
+        neg = 1;
+        ax = -sx;
+    }
+    else
+        ax = sx;
+
+    q = ax / st;
+    r = ax % st;
+
+    /* keep r * num within 32 bit */
+    while( st > 0xffff )
+    {
+        st >>= 1;
+        r >>= 1;
+    }
+
+    if( q > 0xffff )
+        q = 0x7fff;
+    else
+    {
+        q = (q * num + r * num / st) / den;
+        if( q > 0x7fff )
+            q = 0x7fff;
+    }
+
+    return neg ? -(int16_t)q : (int16_t)q;
+}
+
+
+//! feeds compare_is into the estimators and updates its derivative fields
+/*! To be called once for every new sample (from handle_ds2756_readout()).
+ */
+void battery_update_derivatives(void)
+{
+    uint32_t dt = compare_is.t_ms - deriv.last_t_ms;
+
+    if( !deriv.samples || dt > DERIVATIVE_MAX_GAP_ms )
+    {
+        battery_derivatives_init();
+        deriv.samples = 1;
+    }
+    else
+    {
+        int16_t du = compare_is.U_mV - deriv.last_U_mV;
+        int16_t dT = compare_is.T_cCelsius - deriv.last_T_cCelsius;
+
+        deriv.sx_U += ((int32_t)du << 8) - (deriv.sx_U >> DERIVATIVE_EMA_SHIFT);
+        deriv.sx_T += ((int32_t)dT << 8) - (deriv.sx_T >> DERIVATIVE_EMA_SHIFT);
+        deriv.st   += dt - (deriv.st >> DERIVATIVE_EMA_SHIFT);
+
+        if( deriv.samples < DERIVATIVE_WARMUP )
+            deriv.samples++;
+    }
+
+    deriv.last_U_mV = compare_is.U_mV;
+    deriv.last_T_cCelsius = compare_is.T_cCelsius;
+    deriv.last_t_ms = compare_is.t_ms;
+
+    if( deriv.samples < DERIVATIVE_WARMUP )
+    {
+        compare_is.dU_dt_uV_per_s = 0;
+        compare_is.dT_dt_mC_per_s = 0;
+        return;
+    }
+
+    /* mV/256 per ms to uV per s: 1000000/256 = 15625/4 */
+    compare_is.dU_dt_uV_per_s = ema_slope(deriv.sx_U, deriv.st, 15625, 4);
+
+    /* cC/256 per ms to mC per s: 10000/256 = 625/16 */
+    compare_is.dT_dt_mC_per_s = ema_slope(deriv.sx_T, deriv.st, 625, 16);
+}
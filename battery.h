@@ -45,7 +45,7 @@ typedef struct {
          unsigned int may_charge:1;
          unsigned int may_trickle_charge:1;
            signed int temp_degC;
-         unsigned char bat_chemistry;
+         unsigned char bat_chemistry;   /**< BAT_CHEM_*, from the DS2756 EEPROM */
 
          // as sent to host
          union {
@@ -107,8 +107,22 @@ typedef struct
        uint16_t Q_raw;
        uint16_t R_mOhm;
         int16_t T_cCelsius; /* 1/100 degree Celsius */
+        int16_t dU_dt_uV_per_s;     /* 0 until enough samples are seen */
+        int16_t dT_dt_mC_per_s;     /* 1/1000 degree Celsius per second */
 } battery_is_type;
 
+/* low nibble of the manufacturer/type byte in the DS2756 EEPROM
+   (as read by the OLPC battery driver) */
+#define BAT_CHEM_UNKNOWN (0)
+#define BAT_CHEM_NiMH    (1)
+#define BAT_CHEM_LiFe    (2)
+
 extern bool battery_news;
+extern bool bat_chem_LiFe;
 
 bool handle_battery(void);
+void charge_pwm_init(void);
+void set_charge_mode( unsigned char cur, unsigned int limit_mV );
+void charge_regulator_update(void);
+void battery_derivatives_init(void);
+void battery_update_derivatives(void);
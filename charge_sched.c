@@ -88,12 +88,11 @@
 #include "power.h"
 #include "states.h"
 #include "timer.h"
+#include "trace.h"
 #include "uart.h"
 
 #define DEBUG 1
 
-extern void set_charge_mode( unsigned char cur );
-
 
 //! number of entries in the table. (Power of 2)
 #define BATTERY_COMPARE_NUM (8)
@@ -135,7 +134,9 @@ battery_compare_type __code compare_rom_hi_charge_NiMH =
     {0,         0},             /* Q_raw */      /* do not trust this blindly... */
     {0,         0},             /* R_mOhm */
     {ROM_OFF,   5200-500},      /* T_Celsius */  /* no charging above 52degC. Safety margin */
-     0x80
+    {0,         0},             /* dU_dt_uV_per_s */
+    {ROM_OFF,   17},            /* dT_dt_mC_per_s */ /* NiMH termination at 1degC/minute */
+     40                         /* charging */   /* 400 mA */
 };
 
 
@@ -150,7 +151,9 @@ battery_compare_type __code compare_rom_lo_charge_NiMH =
     {0, 0},                     /* Q_raw */
     {0, 0},                     /* R_mOhm */
     {ROM_OFF,   0},             /* T_Celsius */  /* no charging below 0degC and no quick charge below +15degC? */
-    0x80
+    {0,         -400},          /* dU_dt_uV_per_s */ /* -dV termination. Not enabled yet, value untested */
+    {0,         0},             /* dT_dt_mC_per_s */
+    40
 };
 
 
@@ -172,13 +175,6 @@ battery_compare_type __code compare_rom_hi_charge_LiFe =
 };
 
 
-/*! dummy */
-void set_charge_mode( unsigned char cur )
-{
-    cur;
-}
-
-
 //! copy memory from code to xdata space.
 /*! This is not a exaxt memcpy clone */
 void memcpy_xc( unsigned char __xdata *dst,
@@ -215,6 +211,16 @@ void battery_charging_table_set_hi( unsigned char num, unsigned char __xdata *sr
     memcpy_xx( (void *)&compare_x_hi[num], src, sizeof compare_x_hi[0]);
 }
 
+//! tell the charge regulator what the active entry wants
+/*! charging is the charge current in units of 10 mA (0 is off),
+    the constant voltage limit is the upper U_mV limit (if active).
+    (c_hi_ptr->charging == c_lo_ptr->charging) */
+static void apply_charge_mode( void )
+{
+    set_charge_mode( c_hi_ptr->charging,
+                     c_hi_ptr->U_mV.act ? c_hi_ptr->U_mV.val : 0 );
+}
+
 //! switch to the specified entry
 void battery_charging_table_set_num( unsigned char num )
 {
@@ -229,11 +235,12 @@ void battery_charging_table_set_num( unsigned char num )
     c_lo_ptr->t_ms.val = compare_is.t_ms + c_lo_ptr->delta_t_ms;
 
     /* and now switch battery charging accordingly... */
-//    set_charge_mode( c_hi_ptr->charging &0xc0 ); /* c_hi_ptr->charging == c_lo_ptr->charging */
+    apply_charge_mode();
 
     num_in_use = num;
 
     STATES_UPDATE(charge_sched, num_in_use);
+    trace_state(TRACE_CHARGE_SCHED, num_in_use);
 }
 
 unsigned char battery_charging_table_get_num( void )
@@ -288,9 +295,13 @@ bool handle_battery_charging_table( void )
      */
     if( !IS_AC_IN_ON )
     {
-        set_charge_mode( 0 );
+        set_charge_mode( 0, 0 );
         return 0;
     }
+
+    /* came back from no external power? */
+    if( !battery.may_charge && c_hi_ptr->charging )
+        apply_charge_mode();
     #endif
 
     #if 0
@@ -324,6 +335,14 @@ bool handle_battery_charging_table( void )
     {
         action = c_hi_ptr->T_cCelsius.act;
     }
+    else if( c_hi_ptr->dU_dt_uV_per_s.act && compare_is.dU_dt_uV_per_s > c_hi_ptr->dU_dt_uV_per_s.val )
+    {
+        action = c_hi_ptr->dU_dt_uV_per_s.act;
+    }
+    else if( c_hi_ptr->dT_dt_mC_per_s.act && compare_is.dT_dt_mC_per_s > c_hi_ptr->dT_dt_mC_per_s.val )
+    {
+        action = c_hi_ptr->dT_dt_mC_per_s.act;
+    }
     /* and now for the pointer holding the lower margins */
     else if( c_lo_ptr->U_mV.act && compare_is.U_mV < c_lo_ptr->U_mV.val )
     {
@@ -341,6 +360,14 @@ bool handle_battery_charging_table( void )
     {
         action = c_lo_ptr->T_cCelsius.act;
     }
+    else if( c_lo_ptr->dU_dt_uV_per_s.act && compare_is.dU_dt_uV_per_s < c_lo_ptr->dU_dt_uV_per_s.val )
+    {
+        action = c_lo_ptr->dU_dt_uV_per_s.act;
+    }
+    else if( c_lo_ptr->dT_dt_mC_per_s.act && compare_is.dT_dt_mC_per_s < c_lo_ptr->dT_dt_mC_per_s.val )
+    {
+        action = c_lo_ptr->dT_dt_mC_per_s.act;
+    }
     else
         return 0;
 
@@ -358,7 +385,7 @@ bool handle_battery_charging_table( void )
 
 
     /* and now switch battery charging accordingly... */
-//    set_charge_mode( c_hi_ptr->charging &0xc0 ); /* c_hi_ptr->charging == c_lo_ptr->charging */
+    apply_charge_mode();
 
     /* LED colour set just to see something */
     BATT_LED_JINGLE_500ms();
@@ -373,6 +400,7 @@ bool handle_battery_charging_table( void )
     num_in_use = action;
 
     STATES_UPDATE(charge_sched, num_in_use);
+    trace_state(TRACE_CHARGE_SCHED, num_in_use);
 
     return 1;
 }
@@ -53,7 +53,7 @@ typedef struct
 
 typedef struct
 {
-    //(t, V, I, Q, R, T, eventually: dV/dt, dT/dt).
+    //(t, V, I, Q, R, T, dV/dt, dT/dt).
     action_and_val_uint32_type t_ms;
     uint32_t delta_t_ms;
 
@@ -63,15 +63,13 @@ typedef struct
     action_and_val_uint16_type R_mOhm;       /* not handled */
     action_and_val_int16_type  T_cCelsius;   /* in 1/100 degree Celsius */
 
-    /* if needed host should keep this variables.
-       We do not want to come near these critical entities and
-       do not want to pretend to be able to handle them reasonably.
-       So better do not have these entities here?
-    action_and_val_int16_type dU_dT_in_mV_per_s; 
-    action_and_val_int16_type dT_dt_in_mC_per_s;
-    */
+    /* smoothed derivatives as estimated by battery.c.
+       They read 0 until the estimator has seen enough samples
+       so a table entry using them does not trigger early. */
+    action_and_val_int16_type  dU_dt_uV_per_s;
+    action_and_val_int16_type  dT_dt_mC_per_s;
 
-    uint8_t charging;
+    uint8_t charging;           /* charge current in units of 10 mA, 0 is off */
 
 } battery_compare_type;
 
@@ -361,20 +361,24 @@ SFRX(GPWUEN00,  0xff30);        /**< GPIO Event Enable and Asynchronous Wake Up
 SFRX(GPWUEN08,  0xff31);
 SFRX(GPWUEN10,  0xff32);
 SFRX(GPWUEN18,  0xff33);
+SFRX(GPWUENE0,  0xff34);        /**< unconfirmed, GPIOE00..07 (KEY_IN_n) */
 
 SFRX(GPWUPF00,  0xff40);        /**< GPIO Event Pending Flag */
 SFRX(GPWUPF08,  0xff41);
 SFRX(GPWUPF10,  0xff42);
 SFRX(GPWUPF18,  0xff43);
+SFRX(GPWUPFE0,  0xff44);        /**< unconfirmed */
 
 SFRX(GPWUPS00,  0xff50);        /**< GPIO Polarity Selection */
 SFRX(GPWUPS08,  0xff51);
 SFRX(GPWUPS10,  0xff52);
 SFRX(GPWUPS18,  0xff53);
+SFRX(GPWUPSE0,  0xff54);        /**< unconfirmed */
 
 SFRX(GPWUEL00,  0xff60);        /**< GPIO Edge/Level Trigger Selection */
 SFRX(GPWUEL08,  0xff61);
 SFRX(GPWUEL10,  0xff62);
 SFRX(GPWUEL18,  0xff63);
+SFRX(GPWUELE0,  0xff64);        /**< unconfirmed */
 
 #endif
@@ -185,6 +185,7 @@
 # define __using(x)
 # define __interrupt(x)
 # define __naked
+# define __banked
 
 #endif
 
@@ -41,25 +41,30 @@
 #include "../chip.h"
 #include "../battery.h"
 #include "../charge_sched.h"
+#include "../fixmath.h"
+#include "../history.h"
 #include "../led.h"
 #include "../one_wire.h"
+#include "../soc.h"
 #include "../states.h"
 #include "../timer.h"
+#include "../trace.h"
 #include "../uart.h"
 #include "../watchdog.h"
 
+#define LOG_MODULE LOG_MODULE_DS2756
+#include "../log.h"
+
 /* see also: http://www.ibutton.com/
  */
 
-#define DEBUG 1
-#if DEBUG && defined(SDCC)
-# include <stdio.h>
-# define PRINTF(...) printf_tiny(__VA_ARGS__)     /* printf is just here for debugging */
-#else
-# define PRINTF(...)
-#endif
 
 
+#define GUESSED_BATTERY_IMPEDANCE_mOHM 180
+
+//! EEPROM address of the manufacturer (high nibble) and chemistry (low nibble)
+#define DS2756_ADDR_MFR_TYPE (0x5f)
+
 //! data from battery sensor
 struct data_ds2756_type __xdata data_ds2756;
 
@@ -140,8 +145,7 @@ bool handle_ds2756_requests(void)
 
             if( (data_ds2756.long_time_error.c ^ data_ds2756.error.c) & data_ds2756.error.c)
             {
-                putstring("\r\nNew DS2756 E:");
-                puthex(data_ds2756.error.c);
+                SLOG1("\r\nNew DS2756 E:%02x", data_ds2756.error.c);
             }
 
             data_ds2756.long_time_error.c |= data_ds2756.error.c;
@@ -149,6 +153,9 @@ bool handle_ds2756_requests(void)
             data_ds2756.error.no_device = 1;
             data_ds2756.error.no_device_flag_is_invalid = 1;
 
+            /* the battery might have been exchanged */
+            soc_reset();
+
             ow_transfer_buf[0] = 0x33;
             ow_transfer_init( 1, 8 );
 
@@ -355,6 +362,11 @@ bool handle_ds2756_requests(void)
    /* and to debugging area (if enabled) */
    STATES_UPDATE(ds2756, state);
 
+   /* not the transfer cycle 5 -> 8 -> 9 -> 5 (or 6, 7) */
+   if( state < 6 || state > 9 )
+       trace_state(TRACE_DS2756, state);
+   trace_state(TRACE_OW_ERROR, data_ds2756.error.c);
+
    return 0;
 }
 
@@ -364,8 +376,7 @@ void set_batt_led_colour()
 {
     unsigned int u = compare_is.U_mV;
 
-    #define GUESSED_BATTERY_IMPEDANCE_mOHM 180
-    u -= (long)compare_is.I_mA * GUESSED_BATTERY_IMPEDANCE_mOHM / 1000;
+    u -= mul_s16_frac(compare_is.I_mA, FRAC_0_18); /* GUESSED_BATTERY_IMPEDANCE_mOHM */
 
     if( data_ds2756.error.no_device )
     {
@@ -407,7 +418,7 @@ bool handle_ds2756_readout(void)
     {
         case 0:
             if( data_ds2756.serial_number_valid )
-                 state = 1;
+                 state = 7;
             break;
 
         case 1:
@@ -504,9 +515,14 @@ bool handle_ds2756_readout(void)
             compare_is.I_mA = ds2756_raw_I_to_mA(data_ds2756.current_raw);
             compare_is.Q_raw = data_ds2756.charge_raw;
             compare_is.T_cCelsius = ds2756_raw_T_to_cC(data_ds2756.temp_raw);
+            battery_update_derivatives();
+            soc_update();
+            charge_regulator_update();
 
             set_batt_led_colour(); /* should be in battery.c */
 
+            history_append();
+
             battery_news = 1;
             state = 6;
             break;
@@ -515,174 +531,244 @@ bool handle_ds2756_readout(void)
             state = 1;
             break;
 
+        case 7:
+            /* identify the chemistry before the first readout */
+            buf[0] = 0xcc;  /* skip net address */
+            buf[1] = 0x69;  /* read */
+            buf[2] = DS2756_ADDR_MFR_TYPE;
+
+            data_ds2756.batt_transfer.buf = buf;
+            data_ds2756.batt_transfer.RX_len = 1;
+            data_ds2756.batt_transfer.TX_len = 3;
+            data_ds2756.batt_transfer.request_completed = 0;
+            data_ds2756.batt_transfer.request_new = 1;
+            data_ds2756.batt_transfer.error.c = 0x00;
+
+            state = 8;
+            break;
+
+        case 8:
+            if( data_ds2756.batt_transfer.request_completed )
+            {
+                data_ds2756.batt_transfer.request_new = 0;
+                if( !data_ds2756.batt_transfer.error.c )
+                {
+                    battery.bat_chemistry = buf[0] & 0x0f;
+                    /* unknown is handled as NiMH */
+                    bat_chem_LiFe = (battery.bat_chemistry == BAT_CHEM_LiFe);
+                    state = 1;
+                }
+                else
+                    state = 0;
+            }
+            break;
+
     }
-    return state >= 5;
+    return state >= 5 && state <= 6;
 }
 
 //! fixed point conversion routine
 /*! The ds2756 data on the EC could also be handled as raw values.
     (thus not needing a conversion after acquistion)
     But having the data in their "proper units" is better to maintain/debug.
-    The conversion routines try to avoid 16 bit multiply
-    and divide library functions but may have accuracy problems.
+    The conversion routines use the multiply-by-fraction kernels
+    from fixmath.c. They return exactly what the 32 bit long math
+    ((long)r * 1302 / 10000 etc.) returns, see ds2756_check_conversions().
  */
 int ds2756_raw_I_to_mA(int r)
 {
-#if 1
-
-    return (int)((long)r * 1302 / 10000);
-
-#else
-
-    int j;
-    unsigned char sign = 0;
-
-    if( r < 0 )
-    {
-        r = -r;
-        sign = 1;
-    }
-    // *0.1302(dec) is *0,001000010101010(bin)
-    j  = (unsigned)r >> 3;
-
-    j += (unsigned)r >> 8;
-
-    j += (unsigned)r >> 10;
-
-    if( sign )
-        j = -j;
-
-    return j;
-
-#endif
+    return mul_s16_frac(r, FRAC_0_1302);
 }
 
 
 //! difficult to handle if argument over-/underflows from 0x7fff to 0x8000
 int ds2756_raw_Q_to_mAh(int r)
 {
-#if 1
+    return mul_s16_frac(r, FRAC_0_4167);
+}
 
-    return (int)((long)r * 4167 / 10000);
 
-#else
+unsigned int ds2756_raw_U_to_mV(unsigned int r)
+{
+    return mul_u16_frac(r, FRAC_0_3);
+}
+
 
+//! converting to centi Celsius (1/100 degree Centigrade)
+/*! the upper byte is degrees Celsius. Rounded to the nearest
+    centi degree (0.125 degC is 13 cC), symmetric around 0 degC.
+ */
+unsigned int ds2756_raw_T_to_cC(signed int r)
+{
     unsigned int t;
-    unsigned int q;
-    unsigned char i;
-    unsigned char sign = 0;
 
+    /* twice the result, then round */
     if( r < 0 )
     {
-        r = -r;
-        sign = 1;
+        t = mul_u16_frac(-(unsigned int)r, FRAC_200_256);
+        return -(int)((t + 1) >> 1);
     }
-    // *0.4167(dec) is *0,01101010101011001(bin)
-    t = (unsigned)r >> 2;
-    q = t;
-    t >>= 1;
-    q += t;
-    i = 3;
-    do
-    {
-        t >>= 2;
-        q += t;
-    } while(--i);
 
-    if( sign )
-        q = -q;
+    t = mul_u16_frac(r, FRAC_200_256);
+    return (t + 1) >> 1;
+}
+
 
-    return q;
+//! long math reference for the conversion kernels
+static int ref_conversion(unsigned char which, unsigned int r)
+{
+    long t;
 
-#endif
+    switch( which )
+    {
+        case 0:
+            return (int)((long)(int)r * 1302 / 10000);
+        case 1:
+            return (int)((long)(int)r * 4167 / 10000);
+        case 2:
+            return (int)((long)r * 3 / 10);
+        case 3:
+            return (int)((long)(int)r * GUESSED_BATTERY_IMPEDANCE_mOHM / 1000);
+        default:
+            t = (long)(int)r * 100;
+            if( t < 0 )
+                return (int)((t - 128) / 256);
+            return (int)((t + 128) / 256);
+    }
 }
 
-unsigned int ds2756_raw_U_to_mV(unsigned int r)
+
+static int fast_conversion(unsigned char which, unsigned int r)
 {
-#if 1
+    switch( which )
+    {
+        case 0:
+            return ds2756_raw_I_to_mA(r);
+        case 1:
+            return ds2756_raw_Q_to_mAh(r);
+        case 2:
+            return ds2756_raw_U_to_mV(r);
+        case 3:
+            return mul_s16_frac(r, FRAC_0_18);
+        default:
+            return ds2756_raw_T_to_cC(r);
+    }
+}
 
-    return (int)((long)r * 3 / 10);
 
-#else
+#define CONVERSION_NUM (5)
+#define CONVERSION_BENCH_CALLS (8)
 
-    unsigned int u,t;
+//! Timer0 counts for CONVERSION_BENCH_CALLS calls, best of 4 runs
+static unsigned int bench_conversion(unsigned char which, bool fast)
+{
+    unsigned char run;
     unsigned char i;
+    unsigned int best = 0xffff;
 
-    // *0.3(dec) is *0,010011001100110011...(bin)
-    t = r >> 2;
-    u = t;
+    TR0 = 0;
+    TMOD &= 0xf0;
+    TMOD |= 0x01;   /* 16 bit timer, no IRQ */
 
-    i = 3;
-    do
+    for( run = 0; run < 4; run++ )
     {
-        t >>= 3;
-        u += t;
+        unsigned int t;
 
-        t >>= 1;
-        u += t;
-    } while(--i);
-
-    return u;
+        TH0 = 0;
+        TL0 = 0;
+        TF0 = 0;
+        TR0 = 1;
+        for( i = 0; i < CONVERSION_BENCH_CALLS; i++ )
+        {
+            if( fast )
+                fast_conversion(which, 0x8765);
+            else
+                ref_conversion(which, 0x8765);
+        }
+        TR0 = 0;
 
-#endif
+        t = ((unsigned int)TH0 << 8) | TL0;
+        if( TF0 )
+            t = 0xffff;
+        if( t < best )
+            best = t;
+    }
+    return best;
 }
 
-//! converting to centi Celsius (1/100 degree Centigrade)
-// OK below 0degC ?
-unsigned int ds2756_raw_T_to_cC(signed int r)
+
+//! compares the conversion kernels with the long math reference
+/*! Checks the full 16 bit input range of every conversion.
+    This takes a while so it is done in steps of 32 values
+    per call. Prints a benchmark (Timer0 counts for 8 calls
+    of reference/kernel) first.
+    \return 1 when done
+ */
+bool ds2756_check_conversions(bool start)
 {
-    int t;
-    unsigned char d;
-    static unsigned char table[8] = { 0, 13, 25, 38, 50, 63, 75, 88 };
+    static unsigned int __xdata r;
+    static unsigned int __xdata errors;
+    unsigned char which;
+    unsigned char i;
 
-    // upper byte directly is degrees Celsius
-    t = (r >> 8) * 100;
+    if( start )
+    {
+        r = 0;
+        errors = 0;
 
-    // lower byte passed through table
-    d = table[(unsigned char)r / 0x20];
+        for( which = 0; which < CONVERSION_NUM; which++ )
+        {
+            SLOG3("\r\n%c ref:%04x fast:%04x", '0' + which, bench_conversion(which, 0), bench_conversion(which, 1));
+        }
+        putcrlf();
+        return 0;
+    }
 
-    if( r<0 )
-        return t - d;
-    else
-        return t + d;
+    i = 32;
+    do
+    {
+        for( which = 0; which < CONVERSION_NUM; which++ )
+        {
+            if( fast_conversion(which, r) != ref_conversion(which, r) )
+            {
+                if( !errors )
+                {
+                    SLOG2("\r\nmismatch %c %04x", '0' + which, r);
+                }
+                errors++;
+            }
+        }
+        r++;
+    } while( --i );
+
+    if( !(r & 0x0fff) )
+        putchar('.');
+
+    if( r )
+        return 0;
+
+    SLOG1("\r\nerrors:%04x", errors);
+    return 1;
 }
 
+
 void dump_ds2756()
 {
     unsigned char i;
 
     if( data_ds2756.error.no_device )
-        putstring("\r\nno batt");
+        SLOG0("\r\nno batt");
     else
     {
         putstring("\r\nSer:");
         for( i = 0; i < sizeof data_ds2756.serial_number; i++ )
             puthex(data_ds2756.serial_number[i]);
 
-        putstring(" U_raw:");
-        puthex_u16(data_ds2756.voltage_raw);
-
-        putstring(" I_raw:");
-        puthex_u16(data_ds2756.current_raw);
-
-        putstring(" I_avg_raw:");
-        puthex_u16(data_ds2756.avg_current_raw);
-
-        putstring(" Q_raw:");
-        puthex_u16(data_ds2756.charge_raw);
-
-        putstring(" T_raw:");
-        puthex_u16(data_ds2756.temp_raw);
-
-        putstring(" E:");
-        puthex(data_ds2756.long_time_error.c);
-        puthex(data_ds2756.error.c);
+        SLOG3(" U_raw:%04x I_raw:%04x I_avg_raw:%04x", data_ds2756.voltage_raw, data_ds2756.current_raw, data_ds2756.avg_current_raw);
+        SLOG3(" Q_raw:%04x T_raw:%04x E:%04x", data_ds2756.charge_raw, data_ds2756.temp_raw, ((unsigned int)data_ds2756.long_time_error.c << 8) | data_ds2756.error.c);
 
-        PRINTF(" %umV",  ds2756_raw_U_to_mV(data_ds2756.voltage_raw));
-        PRINTF(" %dmA",  ds2756_raw_I_to_mA(data_ds2756.current_raw));
-        PRINTF(" %dmA",  ds2756_raw_I_to_mA(data_ds2756.avg_current_raw));
-        PRINTF(" %dmAh", ds2756_raw_Q_to_mAh(data_ds2756.charge_raw));
-        PRINTF(" %dcC", ds2756_raw_T_to_cC(data_ds2756.temp_raw));
+        SLOG3(" %umV %dmA %dmA", ds2756_raw_U_to_mV(data_ds2756.voltage_raw), ds2756_raw_I_to_mA(data_ds2756.current_raw), ds2756_raw_I_to_mA(data_ds2756.avg_current_raw));
+        SLOG2(" %dmAh %dcC", ds2756_raw_Q_to_mAh(data_ds2756.charge_raw), ds2756_raw_T_to_cC(data_ds2756.temp_raw));
     }
 }
 
@@ -696,9 +782,7 @@ bool dump_ds2756_all()
 
     for( i = 0; i < 0x8f; i += 8 )
     {
-        putstring("\r\nDS2756 ");
-        puthex(i);
-        putchar(':');
+        SLOG1("\r\nDS2756 %02x:", i);
 
         ow_transfer_buf[0] = 0xcc;  /* skip net address */
         ow_transfer_buf[1] = 0x69;  /* read */
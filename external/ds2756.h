@@ -63,3 +63,4 @@ int ds2756_raw_I_to_mA(int r);
 int ds2756_raw_Q_to_mAh(int r);
 unsigned int ds2756_raw_U_to_mV(unsigned int r);
 unsigned int ds2756_raw_T_to_cC(signed int r);
+bool ds2756_check_conversions(bool start);
@@ -0,0 +1,128 @@
+/*-------------------------------------------------------------------------
+   fixmath.c - fixed point helpers for the EC of the OLPC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+/*! \file fixmath.c
+
+   Multiplication with a constant fraction instead of the
+   (long)x * num / den construct. The latter pulls in the
+   32 bit multiply and the 32 bit divide library routines,
+   which are very slow on the 8051.
+
+   x * num / den is replaced by (x * frac) >> 32 with
+   frac = ceil(num * 2^32 / den). For the constants in fixmath.h
+   this gives the same result as the long math for every 16 bit x.
+   The product needs 8 MUL AB instructions.
+ */
+
+#include "compiler.h"
+#include "fixmath.h"
+
+
+//! 16 x 16 -> 32 bit unsigned multiply
+/*! SDCC would use the 32 x 32 bit library multiply for
+    (unsigned long)a * b
+ */
+#if defined(SDCC)
+unsigned long mul_u16_u16(unsigned int a, unsigned int b) __naked
+{
+    a;  /* avoid warning about unused variable */
+    b;  /* avoid warning about unused variable */
+
+    __asm
+        mov     r2,dpl                  ; a lo
+        mov     r3,dph                  ; a hi
+
+        mov     a,r2                    ; a lo * b lo
+        mov     b,_mul_u16_u16_PARM_2
+        mul     ab
+        mov     r4,a
+        mov     r5,b
+
+        mov     a,r3                    ; a hi * b hi
+        mov     b,(_mul_u16_u16_PARM_2 + 1)
+        mul     ab
+        mov     r6,a
+        mov     r7,b
+
+        mov     a,r2                    ; a lo * b hi
+        mov     b,(_mul_u16_u16_PARM_2 + 1)
+        mul     ab
+        add     a,r5
+        mov     r5,a
+        mov     a,b
+        addc    a,r6
+        mov     r6,a
+        clr     a
+        addc    a,r7
+        mov     r7,a
+
+        mov     a,r3                    ; a hi * b lo
+        mov     b,_mul_u16_u16_PARM_2
+        mul     ab
+        add     a,r5
+        mov     r5,a
+        mov     a,b
+        addc    a,r6
+        mov     r6,a
+        clr     a
+        addc    a,r7
+
+        mov     dpl,r4                  ; return value in dpl, dph, b, a
+        mov     dph,r5
+        mov     b,r6
+        ret
+    __endasm;
+}
+#else
+unsigned long mul_u16_u16(unsigned int a, unsigned int b)
+{
+    return (unsigned long)a * b;
+}
+#endif
+
+
+//! (x * frac) >> 32
+unsigned int mul_u16_frac(unsigned int x, unsigned long frac)
+{
+    unsigned long lo;
+    unsigned long hi;
+
+    lo = mul_u16_u16(x, (unsigned int)frac);
+    hi = mul_u16_u16(x, (unsigned int)(frac >> 16));
+
+    /* cannot overflow: hi <= 0xfffe0001 */
+    hi += (unsigned int)(lo >> 16);
+
+    return (unsigned int)(hi >> 16);
+}
+
+
+//! signed variant, truncates towards zero like the long math does
+int mul_s16_frac(int x, unsigned long frac)
+{
+    if( x < 0 )
+        return -(int)mul_u16_frac(-(unsigned int)x, frac);
+    else
+        return (int)mul_u16_frac(x, frac);
+}
@@ -0,0 +1,39 @@
+/*-------------------------------------------------------------------------
+   fixmath.h - fixed point helpers for the EC of the OLPC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+//! binary fraction for mul_u16_frac(): ceil(num * 2^32 / den)
+/*! These are precomputed because the preprocessor cannot do the
+    64 bit math. The constants are exact (equal to the long math
+    (x * num / den)) for 0 <= x <= 0xffff.
+    See ds2756_check_conversions() for the check on the target.
+ */
+#define FRAC_0_1302   (0x2154c986ul)  /**< 1302/10000 */
+#define FRAC_0_4167   (0x6aacd9e9ul)  /**< 4167/10000 */
+#define FRAC_0_3      (0x4ccccccdul)  /**< 3/10 */
+#define FRAC_0_18     (0x2e147ae2ul)  /**< 180/1000 */
+#define FRAC_200_256  (0xc8000000ul)  /**< 200/256 */
+
+unsigned long mul_u16_u16(unsigned int a, unsigned int b);
+unsigned int mul_u16_frac(unsigned int x, unsigned long frac);
+int mul_s16_frac(int x, unsigned long frac);
@@ -35,9 +35,12 @@
 #include <stdbool.h>
 #include "chip.h"
 #include "flash.h"
+#include "timer.h"
+#include "trace.h"
 
 //! uses paged memory access to read a location anywhere in the SPI flash
-/*! This routine uses XBISEG1 so it should not be in bank 1 (0x4000..0x7fff)
+/*! This routine uses XBISEG1 so it has to be below 0x4000. The
+    Makefile links flash.rel right after main.rel and checks the map.
  */
 unsigned char flash_read_byte(unsigned char page, unsigned int address)
 {
@@ -65,3 +68,273 @@ unsigned char flash_read_byte(unsigned char page, unsigned int address)
 
 #endif
 }
+
+//! copy a block from anywhere in the SPI flash
+/*! Maps XBISEG1 once per 16k segment (and burst) instead of once
+    per byte. IRQ are disabled for at most FLASH_READ_BURST bytes.
+    Crossing the end of a 64k page continues on the next page.
+    Same restriction as flash_read_byte(), below 0x4000.
+ */
+void flash_read_block(unsigned char page, unsigned int address,
+                      unsigned char __xdata *dst, unsigned int len)
+{
+    while( len )
+    {
+        unsigned int run;
+
+        /* up to the end of the segment */
+        run = 0x4000 - (address & 0x3fff);
+        if( run > len )
+            run = len;
+        if( run > FLASH_READ_BURST )
+            run = FLASH_READ_BURST;
+
+#if defined( SDCC )
+        {
+            unsigned char __xdata *src;
+            unsigned char i;
+            unsigned char ea_save;
+
+            src = (unsigned char __xdata *)((address & 0x3fff) | 0x4000);
+
+            ea_save = EA;
+            EA = 0;
+
+            XBISEG1 = (unsigned char)(page << 2) |
+                      (unsigned char)(address >> 14) |
+                      0x80;
+            for( i = (unsigned char)run; i; i-- )
+                *dst++ = *src++;
+            XBISEG1 = 0;
+
+            EA = ea_save;
+        }
+#else
+        {
+            unsigned char i;
+
+            for( i = (unsigned char)run; i; i-- )
+                *dst++ = 0xff;
+        }
+#endif
+
+        len -= run;
+        address += run;
+        if( !address )
+            page++;
+    }
+}
+
+//! start reading sequentially at page:address
+void flash_stream_open(struct flash_stream_type __xdata *s,
+                       unsigned char page, unsigned int address)
+{
+    s->page = page;
+    s->address = address;
+    s->pos = 0;
+    s->fill = 0;
+}
+
+//! next byte of a flash stream
+/*! Refills are aligned to FLASH_STREAM_BUF so each one is a
+    single mapping of XBISEG1.
+ */
+unsigned char flash_stream_get(struct flash_stream_type __xdata *s)
+{
+    if( s->pos == s->fill )
+    {
+        unsigned char n;
+
+        n = FLASH_STREAM_BUF - ((unsigned char)s->address & (FLASH_STREAM_BUF - 1));
+        flash_read_block( s->page, s->address, s->buf, n );
+
+        s->address += n;
+        if( !s->address )
+            s->page++;
+        s->pos = 0;
+        s->fill = n;
+    }
+
+    return s->buf[s->pos++];
+}
+
+
+//! number of bytes checked per main loop pass
+#define FLASH_CHECKSUM_CHUNK (64)
+
+struct flash_checksum_type __xdata flash_checksum;
+
+static unsigned int __pdata checksum_address;
+
+static struct flash_stream_type __xdata checksum_stream;
+
+
+//! 64k page of the SPI flash the code is running from
+/*! XBISEG0 is set up by the fail-safe code if it relocated us */
+unsigned char flash_running_page(void)
+{
+    if( XBISEG0 & 0x80 )
+        return (XBISEG0 & 0x7c) >> 2;
+    return 0;
+}
+
+//! start to check a 64k page of the SPI flash in the background
+/*! The image carries a 32 bit little endian checksum at 0xfffc
+    (see srec_cat in the Makefile) so that the sum of all 32 bit
+    little endian words of the page is zero.
+ */
+void flash_checksum_start(unsigned char page)
+{
+    flash_checksum.page = page;
+    flash_checksum.sum = 0;
+    flash_checksum.status = FLASH_CHECKSUM_RUNNING;
+    checksum_address = 0x0000;
+    flash_stream_open( &checksum_stream, page, 0x0000 );
+}
+
+//! State machine checking FLASH_CHECKSUM_CHUNK bytes per call
+/*! \return not zero if there is work to be done.
+ */
+bool handle_flash_checksum(void)
+{
+    unsigned char i;
+    unsigned char k;
+    union {
+        unsigned long l;
+        unsigned char c[4];
+    } word;
+
+    if( flash_checksum.status != FLASH_CHECKSUM_RUNNING )
+        return 0;
+
+    word.l = 0;
+
+    for( i = 0; i < FLASH_CHECKSUM_CHUNK / 4; i++ )
+    {
+        for( k = 0; k < 4; k++ )
+            word.c[k] = flash_stream_get( &checksum_stream );
+        flash_checksum.sum += word.l;
+    }
+    checksum_address += FLASH_CHECKSUM_CHUNK;
+
+    if( !checksum_address )
+        flash_checksum.status = flash_checksum.sum ? FLASH_CHECKSUM_BAD : FLASH_CHECKSUM_OK;
+
+    return 1;
+}
+
+
+//! address range the fast clock self-test reads (code, via movc)
+#define FLASH_CLOCK_TEST_START (0x0000)
+#define FLASH_CLOCK_TEST_SIZE  (0x1000)
+#define FLASH_CLOCK_PASSES     (8)
+
+//! give up on the fast clock after this many resets in fast mode
+#define FLASH_CLOCK_MAX_RESETS (3)
+
+//! resets in fast mode further apart than this are not counted
+#define FLASH_CLOCK_STABLE_SECONDS (600)
+
+struct flash_clock_type __xdata __at (0xfa70) flash_clock;
+
+static unsigned int flash_clock_test_sum(void)
+{
+#if defined( SDCC )
+    unsigned char __code *p = (unsigned char __code *)FLASH_CLOCK_TEST_START;
+    unsigned int sum = 0;
+
+    do
+    {
+        /* rotate so swapped bytes are noticed too */
+        sum = (sum << 1 | sum >> 15) + *p++;
+    } while( p != (unsigned char __code *)(FLASH_CLOCK_TEST_START + FLASH_CLOCK_TEST_SIZE) );
+
+    return sum;
+#else
+    return 0;
+#endif
+}
+
+//! switch to the fast SPI clock if the flash can sustain it
+/*! CLKCFG 0xd4 gave about 46% more speed but was found to be
+    unstable with the S25FL008A (see _sdcc_external_startup()).
+    So the test region is read several times with the fast clock
+    and FAST_READ and compared against a read with the slow clock.
+
+    The outcome is kept in flash_clock across resets. A reset during
+    the test, a watchdog IRQ in fast mode (see watchdog_interrupt())
+    or FLASH_CLOCK_MAX_RESETS other resets in fast mode within
+    FLASH_CLOCK_STABLE_SECONDS of each other (see handle_flash_clock())
+    switch back to the slow clock until power is lost.
+    To be called early after reset, after the watchdog is enabled.
+ */
+void flash_clock_init(void)
+{
+    unsigned int reference;
+    unsigned char pass;
+
+    if( flash_clock.magic != FLASH_CLOCK_MAGIC )
+    {
+        /* power up, XRAM content is random */
+        flash_clock.magic = FLASH_CLOCK_MAGIC;
+        flash_clock.state = FLASH_CLOCK_SLOW;
+        flash_clock.resets = 0;
+        flash_clock.failed_pass = 0;
+    }
+    else if( flash_clock.state == FLASH_CLOCK_TESTING )
+        flash_clock.state = FLASH_CLOCK_FAILED;
+    else if( flash_clock.state == FLASH_CLOCK_FAST &&
+             ++flash_clock.resets >= FLASH_CLOCK_MAX_RESETS )
+        flash_clock.state = FLASH_CLOCK_FAILED;
+
+    if( !FLASH_FAST_CLOCK || flash_clock.state == FLASH_CLOCK_FAILED )
+    {
+        trace_event( TRACE_FLASH_CLOCK, flash_clock.state );
+        return;
+    }
+
+    reference = flash_clock_test_sum();
+
+    flash_clock.state = FLASH_CLOCK_TESTING;
+    SPICFG |= FLASH_SPICFG_FAST_READ;
+    CLKCFG = FLASH_CLKCFG_FAST;
+
+    for( pass = 1; pass <= FLASH_CLOCK_PASSES; pass++ )
+    {
+        if( flash_clock_test_sum() != reference )
+        {
+            CLKCFG = FLASH_CLKCFG_SLOW;
+            SPICFG &= ~FLASH_SPICFG_FAST_READ;
+            flash_clock.failed_pass = pass;
+            flash_clock.state = FLASH_CLOCK_FAILED;
+            break;
+        }
+    }
+
+    if( flash_clock.state == FLASH_CLOCK_TESTING )
+        flash_clock.state = FLASH_CLOCK_FAST;
+
+    trace_event( TRACE_FLASH_CLOCK, flash_clock.state );
+}
+
+//! forget the resets in fast mode after a while without one
+/*! Called from the main loop.
+ */
+void handle_flash_clock(void)
+{
+    static unsigned char __pdata my_tick;
+    static unsigned int __pdata seconds;
+
+    if( flash_clock.state != FLASH_CLOCK_FAST || !flash_clock.resets )
+        return;
+
+    if( (unsigned char)((unsigned char)tick - my_tick) < HZ )
+        return;
+    my_tick = (unsigned char)tick;
+
+    if( ++seconds >= FLASH_CLOCK_STABLE_SECONDS )
+    {
+        seconds = 0;
+        flash_clock.resets = 0;
+    }
+}
@@ -22,4 +22,73 @@
    what you give them.   Help stamp out software-hoarding!
 -------------------------------------------------------------------------*/
 
+//! maximum number of bytes read with IRQ disabled
+#define FLASH_READ_BURST (16)
+
+//! size of the buffer of a flash stream (power of 2, <= 0x4000)
+#define FLASH_STREAM_BUF (16)
+
+//! sequential reader, \see flash_stream_get()
+struct flash_stream_type {
+    unsigned char page;
+    unsigned int address;           /**< of the byte following buf[] */
+    unsigned char pos;
+    unsigned char fill;
+    unsigned char buf[FLASH_STREAM_BUF];
+};
+
 unsigned char flash_read_byte(unsigned char page, unsigned int address);
+void flash_read_block(unsigned char page, unsigned int address,
+                      unsigned char __xdata *dst, unsigned int len);
+void flash_stream_open(struct flash_stream_type __xdata *s,
+                       unsigned char page, unsigned int address);
+unsigned char flash_stream_get(struct flash_stream_type __xdata *s);
+
+#define FLASH_CHECKSUM_IDLE    (0)   /**< never started */
+#define FLASH_CHECKSUM_RUNNING (1)
+#define FLASH_CHECKSUM_OK      (2)
+#define FLASH_CHECKSUM_BAD     (3)
+
+//! result of the background checksum, sent as is to the host
+struct flash_checksum_type {
+    unsigned char status;
+    unsigned char page;             /**< 64k page of the SPI flash */
+    unsigned long sum;              /**< little endian */
+};
+
+extern struct flash_checksum_type __xdata flash_checksum;
+
+unsigned char flash_running_page(void);
+void flash_checksum_start(unsigned char page);
+bool handle_flash_checksum(void);
+
+//! try the faster SPI clock at boot, \see flash_clock_init()
+#define FLASH_FAST_CLOCK (1)
+
+#define FLASH_CLKCFG_SLOW (0x94)    /**< as dumped by ec-dump.fth */
+#define FLASH_CLKCFG_FAST (0xd4)    /**< bit 6: full speed SPI clock */
+#define FLASH_SPICFG_FAST_READ (0x04)
+
+#define FLASH_CLOCK_MAGIC (0xc10c)
+
+#define FLASH_CLOCK_SLOW    (0)     /**< not tried (yet) */
+#define FLASH_CLOCK_TESTING (1)     /**< a reset here means the test failed */
+#define FLASH_CLOCK_FAST    (2)
+#define FLASH_CLOCK_FAILED  (3)     /**< sticky until power is lost */
+
+//! outcome of the fast clock self-test, survives a reset
+/*! Lives in the preserved area just below trace_header
+    (--xram-size in the Makefile).
+ */
+struct flash_clock_type {
+    unsigned int magic;
+    unsigned char state;
+    unsigned char resets;           /**< recent resets while in fast mode */
+    unsigned char failed_pass;      /**< pass that did not match, 0 if none */
+    unsigned char reserved[3];
+};
+
+extern struct flash_clock_type __xdata __at (0xfa70) flash_clock;
+
+void flash_clock_init(void);
+void handle_flash_clock(void);
@@ -0,0 +1,389 @@
+/*-------------------------------------------------------------------------
+   flash_prog.c - program the SPI flash
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+/*! \file flash_prog.c
+
+   Erase and program the SPI flash through the XBI command registers,
+   driven by the host via port 0x6c:
+
+   - 0x44 start: host sends page, address hi, address lo
+   - 0x45 erase the 64k sector of that page
+   - 0x46 64 bytes of data, programmed at address which then advances
+   - 0x47 read struct flash_prog_status_type
+
+   There are two upload buffers so the host can send the next 64 bytes
+   while the previous ones are programmed. Before sending data the host
+   should check (0x47) that a buffer is free (full != 0x03).
+
+   While the flash executes a command, code cannot be fetched from it.
+   So the command is issued and waited on by a small routine which is
+   copied to XRAM (XRAM is expected to be mapped into code memory above
+   0xf400). IRQ are disabled meanwhile as their vectors are in flash.
+   This is one page program of 64 bytes (a few ms) but up to a few
+   seconds for a sector erase (the routine kicks the watchdog).
+
+   A page program needs CS# held low for the command, the address
+   and all data bytes. This uses the SPI follow mode of the XBI, in
+   which every write to SPICMD clocks out one byte.
+
+   Register usage of the XBI SPI interface is unconfirmed.
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "bank.h"
+#include "flash.h"
+#include "flash_prog.h"
+#include "port_0x6c.h"
+
+/* SPI flash commands */
+#define SPI_WREN        (0x06)
+#define SPI_RDSR        (0x05)
+#define SPI_PP          (0x02)
+#define SPI_SE          (0xd8)   /**< 64k sector erase */
+
+#define SPI_STATUS_WIP  (0x01)
+
+#define SPICFG_FOLLOW   (0x08)   /**< CS# stays low, SPICMD writes go out raw (unconfirmed) */
+
+//! 64k page with manufacturing data
+#define FLASH_PAGE_MANUFACTURING (0x0e)
+
+struct flash_prog_status_type __xdata flash_prog_status;
+
+unsigned char __xdata flash_prog_buf[3][FLASH_PROG_BUF];
+unsigned char __xdata flash_prog_request[3];
+volatile unsigned char __data flash_prog_full;
+volatile unsigned char __data flash_prog_pending;
+unsigned char __pdata flash_prog_fill_next;
+
+static unsigned char __pdata prog_next;     /**< buffer to program next */
+
+static unsigned char __xdata verify_buf[FLASH_READ_BURST];
+
+#define RAM_ROUTINE_MAX (128)
+
+//! copy of flash_ram_start..flash_ram_end, executed from XRAM
+static unsigned char __xdata ram_routine[RAM_ROUTINE_MAX];
+
+//! cleared if flash_ram_start..flash_ram_end does not fit into ram_routine
+static bool ram_routine_ok;
+
+typedef unsigned char (*ram_command_type)(unsigned char cmd);
+typedef unsigned char (*ram_page_program_type)(unsigned char __xdata *src);
+
+#if defined(SDCC)
+
+extern unsigned char __code flash_ram_start[];
+extern unsigned char __code flash_ram_pp[];
+extern unsigned char __code flash_ram_end[];
+
+//! template of the routine that runs from XRAM
+/*! Position independent (relative jumps only).
+    flash_ram_start: dpl is an SPI command, SPIA0..2 and SPIDAT
+    are set up by the caller.
+    flash_ram_pp: dptr points to FLASH_PROG_BUF bytes in XRAM which
+    are page programmed to SPIA2..0 (WREN has to be sent before).
+    Both wait until the XBI and then the flash (WIP) are done and
+    return the flash status register in dpl.
+ */
+static void flash_ram_template(void) __naked
+{
+    __asm
+    _flash_ram_start::
+        mov     a, dpl
+        mov     dptr, #_SPICMD
+        movx    @dptr, a
+        mov     dptr, #_SPICFG
+    00001$:
+        movx    a, @dptr
+        jb      acc.1, 00001$       ; XBI busy (unconfirmed)
+    flash_ram_wait:
+    00002$:
+        mov     dptr, #_WDTCFG      ; kick the watchdog
+        movx    a, @dptr
+        orl     a, #0x01
+        movx    @dptr, a
+        mov     dptr, #_SPICMD
+        mov     a, #SPI_RDSR
+        movx    @dptr, a
+        mov     dptr, #_SPICFG
+    00003$:
+        movx    a, @dptr
+        jb      acc.1, 00003$
+        mov     dptr, #_SPIDAT
+        movx    a, @dptr
+        jb      acc.0, 00002$       ; SPI_STATUS_WIP
+        mov     dpl, a
+        ret
+
+    _flash_ram_pp::
+        mov     r6, dpl             ; source buffer
+        mov     r7, dph
+        mov     dptr, #_SPICFG
+        movx    a, @dptr
+        orl     a, #SPICFG_FOLLOW
+        movx    @dptr, a            ; CS# low from here on
+        mov     dptr, #_SPICMD
+        mov     a, #SPI_PP
+        movx    @dptr, a
+        mov     dptr, #_SPICFG
+    00010$:
+        movx    a, @dptr
+        jb      acc.1, 00010$
+        mov     r4, #<_SPIA2        ; address bytes, SPIA2 down to SPIA0
+        mov     r5, #3
+    00011$:
+        mov     dpl, r4
+        mov     dph, #>_SPIA2
+        movx    a, @dptr
+        mov     dptr, #_SPICMD
+        movx    @dptr, a
+        mov     dptr, #_SPICFG
+    00012$:
+        movx    a, @dptr
+        jb      acc.1, 00012$
+        dec     r4
+        djnz    r5, 00011$
+        mov     r5, #FLASH_PROG_BUF
+    00013$:
+        mov     dpl, r6
+        mov     dph, r7
+        movx    a, @dptr
+        inc     dptr
+        mov     r6, dpl
+        mov     r7, dph
+        mov     dptr, #_SPICMD
+        movx    @dptr, a
+        mov     dptr, #_SPICFG
+    00014$:
+        movx    a, @dptr
+        jb      acc.1, 00014$
+        djnz    r5, 00013$
+        anl     a, #(0xff ^ SPICFG_FOLLOW)
+        movx    @dptr, a            ; CS# high, the flash starts programming
+        sjmp    flash_ram_wait
+    _flash_ram_end::
+    __endasm;
+}
+
+#endif
+
+//! issue an SPI command with IRQ disabled
+static unsigned char spi_command(unsigned char cmd)
+{
+#if defined(SDCC)
+    unsigned char s;
+    bool ea = EA;
+
+    EA = 0;
+    s = ((ram_command_type)(unsigned int)ram_routine)(cmd);
+    EA = ea;
+
+    return s;
+#else
+    cmd;
+    return 0;
+#endif
+}
+
+//! page program FLASH_PROG_BUF bytes with IRQ disabled
+static unsigned char spi_page_program(unsigned char page, unsigned int address, unsigned char __xdata *src)
+{
+    spi_command( SPI_WREN );
+
+    SPIA2 = page;
+    SPIA1 = (unsigned char)(address >> 8);
+    SPIA0 = (unsigned char)address;
+
+#if defined(SDCC)
+    {
+        unsigned char s;
+        bool ea = EA;
+
+        EA = 0;
+        s = ((ram_page_program_type)(unsigned int)(ram_routine + (flash_ram_pp - flash_ram_start)))(src);
+        EA = ea;
+
+        return s;
+    }
+#else
+    src;
+    return 0;
+#endif
+}
+
+//! write enable, then a command addressing page:address
+static void spi_write_command(unsigned char cmd, unsigned char page, unsigned int address, unsigned char c)
+{
+    spi_command( SPI_WREN );
+
+    SPIA2 = page;
+    SPIA1 = (unsigned char)(address >> 8);
+    SPIA0 = (unsigned char)address;
+    SPIDAT = c;
+
+    spi_command( cmd );
+}
+
+//! pages that must not be changed from here
+static bool page_protected(unsigned char page)
+{
+    unsigned char running = flash_running_page();
+
+    return page == 0x00 ||                      /* reset vector (fail-safe) */
+           (page >= running && page <= running + BANKS) || /* bank.c */
+           page == FLASH_PAGE_MANUFACTURING;
+}
+
+static void fail(unsigned char error)
+{
+    flash_prog_status.state = FLASH_PROG_FAILED;
+    flash_prog_status.error = error;
+}
+
+void flash_prog_init(void)
+{
+#if defined(SDCC)
+    unsigned char i;
+    unsigned int len = flash_ram_end - flash_ram_start;
+
+    /* a partial copy would be jumped into. Refuse to program instead */
+    ram_routine_ok = (len <= RAM_ROUTINE_MAX);
+    if( ram_routine_ok )
+        for( i = 0; i < (unsigned char)len; i++ )
+            ram_routine[i] = flash_ram_start[i];
+#else
+    ram_routine_ok = 1;
+#endif
+
+    flash_prog_status.state = FLASH_PROG_IDLE;
+}
+
+//! State machine programming uploaded data
+/*! \return not zero if there is work to be done.
+ */
+bool handle_flash_prog(void)
+{
+    unsigned char __xdata *buf;
+    unsigned char i;
+
+    if( flash_prog_pending & FLASH_PROG_PENDING_START )
+    {
+        HOST_INTERFACE_INTERRUPT_DISABLE;
+        flash_prog_pending &= ~FLASH_PROG_PENDING_START;
+        flash_prog_full = 0;
+        flash_prog_fill_next = 0;
+        HOST_INTERFACE_INTERRUPT_ENABLE;
+
+        prog_next = 0;
+
+        flash_prog_status.page = flash_prog_request[0];
+        flash_prog_status.address = ((unsigned int)flash_prog_request[1] << 8) |
+                                    flash_prog_request[2];
+        flash_prog_status.error = FLASH_PROG_ERR_NONE;
+        flash_prog_status.state = FLASH_PROG_READY;
+
+        if( !ram_routine_ok )
+            fail( FLASH_PROG_ERR_RAM_ROUTINE );
+
+        if( page_protected( flash_prog_status.page ) )
+            fail( FLASH_PROG_ERR_PROTECTED );
+
+        /* writes must not cross into the next page */
+        if( flash_prog_status.address & (FLASH_PROG_BUF - 1) )
+            fail( FLASH_PROG_ERR_STATE );
+
+        return 1;
+    }
+
+    if( flash_prog_pending & FLASH_PROG_PENDING_ERASE )
+    {
+        HOST_INTERFACE_INTERRUPT_DISABLE;
+        flash_prog_pending &= ~FLASH_PROG_PENDING_ERASE;
+        HOST_INTERFACE_INTERRUPT_ENABLE;
+
+        if( flash_prog_status.state != FLASH_PROG_READY || flash_prog_full )
+            fail( FLASH_PROG_ERR_STATE );
+        else
+            spi_write_command( SPI_SE, flash_prog_status.page, 0x0000, 0xff );
+
+        return 1;
+    }
+
+    if( !(flash_prog_full & (prog_next ? 0x02 : 0x01)) )
+        return 0;
+
+    buf = flash_prog_buf[prog_next];
+
+    if( flash_prog_status.state == FLASH_PROG_READY )
+    {
+        /* the buffer never crosses a 256 byte flash page */
+        spi_page_program( flash_prog_status.page, flash_prog_status.address, buf );
+
+        /* verify the complete buffer */
+        for( i = 0; i < FLASH_PROG_BUF; i++ )
+        {
+            if( !(i & (sizeof verify_buf - 1)) )
+                flash_read_block( flash_prog_status.page,
+                                  flash_prog_status.address + i,
+                                  verify_buf, sizeof verify_buf );
+            if( verify_buf[i & (sizeof verify_buf - 1)] != buf[i] )
+            {
+                fail( FLASH_PROG_ERR_VERIFY );
+                break;
+            }
+        }
+
+        flash_prog_status.address += FLASH_PROG_BUF;
+
+        /* end of the 64k page reached */
+        if( !flash_prog_status.address && flash_prog_status.state == FLASH_PROG_READY )
+            flash_prog_status.state = FLASH_PROG_IDLE;
+    }
+    else
+    {
+        /* not accepted, drop the data */
+        if( flash_prog_status.state != FLASH_PROG_FAILED )
+            fail( FLASH_PROG_ERR_STATE );
+    }
+
+    HOST_INTERFACE_INTERRUPT_DISABLE;
+    flash_prog_full &= prog_next ? ~0x02 : ~0x01;
+    HOST_INTERFACE_INTERRUPT_ENABLE;
+
+    prog_next ^= 1;
+
+    return 1;
+}
@@ -0,0 +1,61 @@
+/*-------------------------------------------------------------------------
+   flash_prog.h - program the SPI flash
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+//! size of a host upload buffer (port 0x6c command 0x46)
+#define FLASH_PROG_BUF (64)
+
+#define FLASH_PROG_IDLE        (0)
+#define FLASH_PROG_READY       (1)   /**< accepting data */
+#define FLASH_PROG_FAILED      (2)   /**< see error, restart with 0x44 */
+
+#define FLASH_PROG_ERR_NONE      (0)
+#define FLASH_PROG_ERR_PROTECTED (1) /**< page in use or reserved */
+#define FLASH_PROG_ERR_VERIFY    (2)
+#define FLASH_PROG_ERR_OVERRUN   (3) /**< data sent while no buffer was free */
+#define FLASH_PROG_ERR_STATE     (4) /**< erase or data without valid 0x44 */
+#define FLASH_PROG_ERR_RAM_ROUTINE (5) /**< XRAM routine does not fit, firmware bug */
+
+//! sent as is to the host (port 0x6c command 0x47)
+struct flash_prog_status_type {
+    unsigned char state;
+    unsigned char error;
+    unsigned char page;
+    unsigned int address;           /**< next byte to be programmed, little endian */
+    unsigned char full;             /**< bit 0, 1: upload buffer in use */
+};
+
+extern struct flash_prog_status_type __xdata flash_prog_status;
+
+/* shared with port_0x6c.c */
+extern unsigned char __xdata flash_prog_buf[3][FLASH_PROG_BUF];  /**< [2] takes overruns */
+extern unsigned char __xdata flash_prog_request[3];              /**< page, address hi, lo */
+extern volatile unsigned char __data flash_prog_full;
+extern volatile unsigned char __data flash_prog_pending;
+extern unsigned char __pdata flash_prog_fill_next;
+
+#define FLASH_PROG_PENDING_START (0x01)
+#define FLASH_PROG_PENDING_ERASE (0x02)
+
+void flash_prog_init(void);
+bool handle_flash_prog(void);
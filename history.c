@@ -0,0 +1,355 @@
+/*-------------------------------------------------------------------------
+   history.c - battery telemetry history for the EC of the OLPC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+/*! \file history.c
+
+   Records every sample of compare_is (t, U, I, Q, T) into a ring
+   buffer so the EC keeps collecting charge curves while the XO
+   is suspended. The host drains the ring in one burst on resume
+   (port 0x6c command 0x40).
+
+   Records are delta encoded against the previous record:
+
+   Keyframe (13 bytes):
+     0xff, t_ms (4), U_mV (2), I_mA (2), Q_raw (2), T_cCelsius (2)
+     (all little endian)
+
+   Delta record (2..9 bytes):
+     header: bit 7..6 size code of delta U
+             bit 5..4 size code of delta I
+             bit 3..2 size code of delta Q
+             bit 1    delta T byte present
+             bit 0    delta t byte present (otherwise 1 s)
+     [dt]            delta t in units of 10 ms
+     [nibbles]       delta U, I, Q as 0, 1, 2 or 4 signed nibbles
+                     (size code 0..3), most significant nibble first,
+                     padded to a full byte
+     [dT]            signed delta T
+
+   Header 0xff is never used for a delta record. Deltas are
+   modulo 2^16 so the decoder simply adds them to the last value.
+
+   A keyframe is written every HISTORY_KEYFRAME_INTERVAL records,
+   whenever dt or dT do not fit and whenever the ring is empty.
+   If the ring is full the oldest keyframe and its deltas are
+   dropped, so the oldest record in the ring always is a keyframe.
+
+   At 1 Hz a quiet battery needs 2..3 bytes per sample, so the
+   ring holds several minutes of data.
+
+   Decoder: tools side, not here:^)
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "battery.h"
+#include "charge_sched.h"
+#include "history.h"
+#include "port_0x6c.h"
+
+//! size of the ring buffer. (Power of 2)
+#define HISTORY_SIZE (512u)
+
+#define HISTORY_KEYFRAME (0xff)
+#define HISTORY_KEYFRAME_LEN (13)
+#define HISTORY_KEYFRAME_INTERVAL (32)
+
+//! delta t if the dt byte is omitted. In units of 10 ms
+#define HISTORY_DT_NOMINAL (100)
+
+#define HISTORY_FLAG_DT (0x01)
+#define HISTORY_FLAG_T  (0x02)
+
+
+static unsigned char __xdata ring[HISTORY_SIZE];
+
+//! index of the next byte to write
+static unsigned int __pdata head;
+//! index of the oldest record (a keyframe)
+static unsigned int __pdata tail;
+//! number of bytes in use
+static unsigned int __pdata used;
+
+static unsigned char __pdata records_since_keyframe;
+
+//! bytes at tail the host was sent last. Removed when it asks again
+static unsigned char __pdata chunk_pending;
+
+//! the values as the decoder on the host side will see them
+static struct {
+    uint32_t t_ms;
+    uint16_t U_mV;
+     int16_t I_mA;
+    uint16_t Q_raw;
+     int16_t T_cCelsius;
+} __xdata last;
+
+//! the record being assembled
+static unsigned char __xdata rec[HISTORY_KEYFRAME_LEN];
+static unsigned char __pdata rec_len;
+static bool rec_half;
+
+//! transfer buffer for port 0x6c, length byte plus data
+static unsigned char __xdata chunk[1 + HISTORY_CHUNK_MAX];
+
+
+//! number of signed nibbles needed for a delta (0, 1, 2 or 4) coded as 0..3
+static unsigned char size_code(unsigned int d)
+{
+    if( !d )
+        return 0;
+    if( (unsigned int)(d + 8) < 16 )
+        return 1;
+    if( (unsigned int)(d + 128) < 256 )
+        return 2;
+    return 3;
+}
+
+
+static void put_nibbles(unsigned int d, unsigned char code)
+{
+    unsigned char n;
+
+    if( !code )
+        return;
+
+    n = (code == 3) ? 4 : code;
+    do
+    {
+        unsigned char nibble;
+
+        n--;
+        nibble = (unsigned char)(d >> (n * 4)) & 0x0f;
+        if( rec_half )
+        {
+            rec[rec_len - 1] |= nibble;
+            rec_half = 0;
+        }
+        else
+        {
+            rec[rec_len++] = nibble << 4;
+            rec_half = 1;
+        }
+    } while( n );
+}
+
+
+static void put_u16(unsigned int v)
+{
+    rec[rec_len++] = (unsigned char)v;
+    rec[rec_len++] = (unsigned char)(v >> 8);
+}
+
+
+//! length of the record starting at index i
+static unsigned char record_len(unsigned int i)
+{
+    unsigned char h = ring[i];
+    unsigned char n;
+    unsigned char len;
+
+    if( h == HISTORY_KEYFRAME )
+        return HISTORY_KEYFRAME_LEN;
+
+    len = 1 + (h & HISTORY_FLAG_DT) + ((h & HISTORY_FLAG_T) >> 1);
+
+    n = 0;
+    h >>= 2;
+    do
+    {
+        unsigned char code = h & 0x03;
+        n += (code == 3) ? 4 : code;
+        h >>= 2;
+    } while( h );
+
+    return len + (n + 1) / 2;
+}
+
+
+//! drop the oldest keyframe and the deltas that depend on it
+static void drop_oldest(void)
+{
+    do
+    {
+        unsigned char len = record_len(tail);
+
+        tail = (tail + len) & (HISTORY_SIZE - 1);
+        used -= len;
+        chunk_pending = (chunk_pending > len) ? chunk_pending - len : 0;
+    } while( used && ring[tail] != HISTORY_KEYFRAME );
+}
+
+
+static void encode_keyframe(void)
+{
+    rec_len = 0;
+    rec[rec_len++] = HISTORY_KEYFRAME;
+    rec[rec_len++] = (unsigned char)compare_is.t_ms;
+    rec[rec_len++] = (unsigned char)(compare_is.t_ms >> 8);
+    rec[rec_len++] = (unsigned char)(compare_is.t_ms >> 16);
+    rec[rec_len++] = (unsigned char)(compare_is.t_ms >> 24);
+    put_u16(compare_is.U_mV);
+    put_u16(compare_is.I_mA);
+    put_u16(compare_is.Q_raw);
+    put_u16(compare_is.T_cCelsius);
+
+    last.t_ms = compare_is.t_ms;
+    records_since_keyframe = 0;
+}
+
+
+//! \return 0 if the sample cannot be delta encoded
+static bool encode_delta(void)
+{
+    uint32_t dt;
+    unsigned int dU, dI, dQ, dT;
+    unsigned char cU, cI, cQ;
+    unsigned char h;
+
+    /* relative to the time the decoder reconstructs,
+       so rounding errors do not accumulate */
+    dt = (compare_is.t_ms - last.t_ms + 5) / 10;
+    if( dt > 0xff )
+        return 0;
+
+    dT = compare_is.T_cCelsius - last.T_cCelsius;
+    if( (unsigned int)(dT + 128) > 255 )
+        return 0;
+
+    dU = compare_is.U_mV - last.U_mV;
+    dI = compare_is.I_mA - last.I_mA;
+    dQ = compare_is.Q_raw - last.Q_raw;
+
+    cU = size_code(dU);
+    cI = size_code(dI);
+    cQ = size_code(dQ);
+
+    h = (cU << 6) | (cI << 4) | (cQ << 2);
+    if( dT )
+        h |= HISTORY_FLAG_T;
+    if( dt != HISTORY_DT_NOMINAL )
+        h |= HISTORY_FLAG_DT;
+
+    if( h == HISTORY_KEYFRAME )
+        return 0;
+
+    rec_len = 0;
+    rec_half = 0;
+    rec[rec_len++] = h;
+    if( h & HISTORY_FLAG_DT )
+        rec[rec_len++] = (unsigned char)dt;
+    put_nibbles(dU, cU);
+    put_nibbles(dI, cI);
+    put_nibbles(dQ, cQ);
+    if( h & HISTORY_FLAG_T )
+        rec[rec_len++] = (unsigned char)dT;
+
+    last.t_ms += (unsigned char)dt * 10u;
+    records_since_keyframe++;
+
+    return 1;
+}
+
+
+void history_init(void)
+{
+    head = 0;
+    tail = 0;
+    used = 0;
+}
+
+
+//! append the current compare_is sample. Expected to be called about once per second
+void history_append(void)
+{
+    unsigned char i;
+
+    /* make room for the largest possible record */
+    while( HISTORY_SIZE - used < HISTORY_KEYFRAME_LEN )
+        drop_oldest();
+
+    /* the oldest record in the ring has to be a keyframe */
+    if( !used ||
+        records_since_keyframe >= HISTORY_KEYFRAME_INTERVAL ||
+        !encode_delta() )
+    {
+        encode_keyframe();
+    }
+
+    last.U_mV = compare_is.U_mV;
+    last.I_mA = compare_is.I_mA;
+    last.Q_raw = compare_is.Q_raw;
+    last.T_cCelsius = compare_is.T_cCelsius;
+
+    for( i = 0; i < rec_len; i++ )
+    {
+        ring[head] = rec[i];
+        head = (head + 1) & (HISTORY_SIZE - 1);
+    }
+    used += rec_len;
+}
+
+
+unsigned int history_used(void)
+{
+    return used;
+}
+
+
+//! hands the oldest records (whole records only) to the host
+/*! The first byte of the response is the number of bytes following.
+    The host is expected to repeat the command until it receives a
+    length of zero. A chunk stays in the ring until the host asks for
+    the next one, so a reply that did not make it is sent again.
+    (A drain that was run until empty starts with a keyframe next time)
+ */
+void history_drain_to_host(unsigned char cmd)
+{
+    unsigned char n = 0;
+    unsigned int t;
+
+    /* the host asks again, so it got the previous chunk */
+    tail = (tail + chunk_pending) & (HISTORY_SIZE - 1);
+    used -= chunk_pending;
+    chunk_pending = 0;
+
+    t = tail;
+    while( n < used )
+    {
+        unsigned char len = record_len(t);
+
+        if( n + len > HISTORY_CHUNK_MAX )
+            break;
+
+        do
+        {
+            chunk[1 + n++] = ring[t];
+            t = (t + 1) & (HISTORY_SIZE - 1);
+        } while( --len );
+    }
+    chunk[0] = n;
+
+    if( respond_to_host(cmd, chunk, n + 1) )
+        chunk_pending = n;
+}
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+   history.h - battery telemetry history for the EC of the OLPC
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+#include "compiler.h"
+
+//! max number of bytes handed to the host per port 0x6c transfer
+/*! transfer_countdown within port_0x6c.c is limited to 127 bytes,
+    one byte is used for the length. */
+#define HISTORY_CHUNK_MAX (126)
+
+void history_init(void);
+void history_append(void);
+void history_drain_to_host(unsigned char cmd);
+unsigned int history_used(void);
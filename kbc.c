@@ -0,0 +1,457 @@
+/*-------------------------------------------------------------------------
+   kbc.c - i8042 compatible keyboard controller on the KBC block
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+/* The KBC block presents the i8042 ports 0x60/0x64 to the host.
+   The EC answers controller commands (port 0x64) itself. Keyboard
+   commands (port 0x60) are sent to the keyboard by handle_ps2(),
+   its replies and scan codes come back through kbc_put_keyboard()
+   which translates them to set 1 while KBC_CB_XLATE is set.
+   The make/break codes of the 3x3 matrix are injected in between,
+   as set 1 codes with KBC_CB_XLATE set and as set 2 codes (or set 1
+   if the keyboard was switched to it) with it cleared.
+
+   The meaning of KBCCFG, KBCCIF and the KBCSTS bits below KBC_STS_AUX
+   is inferred from the LPC68 block and the i8042 status register
+   and is unconfirmed.
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "idle.h"
+#include "kbc.h"
+#include "matrix_3x3.h"
+#include "port_0x6c.h"
+#include "states.h"
+
+#define KBC_CFG_OBF_IRQ (0x01)   /**< IRQ when the host has read the output buffer (unconfirmed) */
+#define KBC_CFG_IBF_IRQ (0x02)   /**< IRQ when the host has written port 0x60/0x64 (unconfirmed) */
+
+#define KBC_CIF_IBF     (0x02)   /**< write to clear IBF (unconfirmed) */
+
+//! bytes on their way to the host
+static unsigned char __xdata kbc_queue[KBC_QUEUE];
+
+//! KBC_STS_AUX or 0x00 for each byte in kbc_queue
+static unsigned char __xdata kbc_queue_aux[KBC_QUEUE];
+
+//! next entry written. Main loop writes with KBC_INTERRUPT_DISABLE
+static unsigned char __pdata kbc_head;
+
+//! next entry sent. Changed within IRQ
+static volatile unsigned char __pdata kbc_tail;
+
+//! controller command waiting for its data byte, 0 if none
+static unsigned char __pdata kbc_pending;
+
+//! keyboard command waiting for its argument byte, 0 if none
+static unsigned char __pdata kbc_kbd_arg;
+
+//! scan code set of the keyboard as switched by keyboard command 0xf0
+static unsigned char __pdata kbc_kbd_set;
+
+//! keyboard scanning as switched by keyboard commands 0xf4/0xf5
+static bool kbc_scanning;
+
+//! the keyboard has sent the first bytes of a code only
+static bool kbc_kbd_partial;
+
+//! 0xf0 from the keyboard has been swallowed by the translation
+static bool kbc_kbd_break;
+
+volatile unsigned char __pdata kbc_aux_out;
+volatile bool kbc_aux_out_pending;
+
+volatile unsigned char __pdata kbc_kbd_out;
+volatile bool kbc_kbd_out_pending;
+
+
+//! queue a byte to the host, drops it if the queue is full
+#define KBC_PUT(c, aux) \
+    do \
+    { \
+        unsigned char next_head = (unsigned char)(kbc_head + 1) & (KBC_QUEUE - 1); \
+        if( next_head != kbc_tail ) \
+        { \
+            kbc_queue[kbc_head] = (c); \
+            kbc_queue_aux[kbc_head] = (aux); \
+            kbc_head = next_head; \
+        } \
+    } while(0)
+
+//! move the next queued byte to the output buffer if the host has read the last one
+#define KBC_SEND_NEXT() \
+    do \
+    { \
+        if( kbc_head != kbc_tail && !(KBCSTS & KBC_STS_OBF) ) \
+        { \
+            if( kbc_queue_aux[kbc_tail] ) \
+                KBCSTS |= KBC_STS_AUX; \
+            else \
+                KBCSTS &= ~KBC_STS_AUX; \
+            KBCDAT = kbc_queue[kbc_tail]; \
+            kbc_tail = (unsigned char)(kbc_tail + 1) & (KBC_QUEUE - 1); \
+        } \
+        /* ask for an IRQ on the next read only if there is more */ \
+        if( kbc_head != kbc_tail ) \
+            KBCCFG |= KBC_CFG_OBF_IRQ; \
+        else \
+            KBCCFG &= ~KBC_CFG_OBF_IRQ; \
+    } while(0)
+
+#define KBC_FREE() ((unsigned char)(kbc_tail - kbc_head - 1) & (KBC_QUEUE - 1))
+
+//! set 2 codes of the set 1 codes 0x64..0x69 (F13..F18) the matrix uses
+static const unsigned char __code kbc_matrix_set2[6] =
+{
+    0x08, 0x10, 0x18, 0x20, 0x28, 0x30
+};
+
+//! i8042 translation of set 2 to set 1, bytes from 0x88 up are unchanged
+static const unsigned char __code kbc_xlate[0x88] =
+{
+    0xff, 0x43, 0x41, 0x3f, 0x3d, 0x3b, 0x3c, 0x58,
+    0x64, 0x44, 0x42, 0x40, 0x3e, 0x0f, 0x29, 0x59,
+    0x65, 0x38, 0x2a, 0x70, 0x1d, 0x10, 0x02, 0x5a,
+    0x66, 0x71, 0x2c, 0x1f, 0x1e, 0x11, 0x03, 0x5b,
+    0x67, 0x2e, 0x2d, 0x20, 0x12, 0x05, 0x04, 0x5c,
+    0x68, 0x39, 0x2f, 0x21, 0x14, 0x13, 0x06, 0x5d,
+    0x69, 0x31, 0x30, 0x23, 0x22, 0x15, 0x07, 0x5e,
+    0x6a, 0x72, 0x32, 0x24, 0x16, 0x08, 0x09, 0x5f,
+    0x6b, 0x33, 0x25, 0x17, 0x18, 0x0b, 0x0a, 0x60,
+    0x6c, 0x34, 0x35, 0x26, 0x27, 0x19, 0x0c, 0x61,
+    0x6d, 0x73, 0x28, 0x74, 0x1a, 0x0d, 0x62, 0x6e,
+    0x3a, 0x36, 0x1c, 0x1b, 0x75, 0x2b, 0x63, 0x76,
+    0x55, 0x56, 0x77, 0x78, 0x79, 0x7a, 0x0e, 0x7b,
+    0x7c, 0x4f, 0x7d, 0x4b, 0x47, 0x7e, 0x7f, 0x6f,
+    0x52, 0x53, 0x50, 0x4c, 0x4d, 0x48, 0x01, 0x45,
+    0x57, 0x4e, 0x51, 0x4a, 0x37, 0x49, 0x46, 0x54,
+    0x80, 0x81, 0x82, 0x41, 0x54, 0x85, 0x86, 0x87
+};
+
+
+//! init hardware and set variables to default state
+void kbc_init(void)
+{
+    KBC_INTERRUPT_DISABLE;
+
+    KBCHWEN = 0x00;  /**< no commands answered by hardware (unconfirmed) */
+    KBCCB = KBC_CB_XLATE | KBC_CB_SYS | KBC_CB_KBD_INT;
+
+    kbc_head = kbc_tail;
+    kbc_pending = 0;
+    kbc_kbd_arg = 0;
+    kbc_kbd_set = 2;
+    kbc_scanning = 1;
+    kbc_kbd_partial = 0;
+    kbc_kbd_break = 0;
+    kbc_aux_out_pending = 0;
+    kbc_kbd_out_pending = 0;
+
+    KBCCFG |= KBC_CFG_IBF_IRQ;
+    KBCCFG &= ~KBC_CFG_OBF_IRQ;
+
+    KBC_INTERRUPT_ENABLE;
+}
+
+
+//! i8042 controller commands, keyboard bytes are passed on
+/*! Answers are queued and sent whenever the host has read the
+    previous byte. Bytes for the keyboard are looked at to follow
+    its scanning state and scan code set.
+    Don't call subroutines here.
+ */
+void kbc_interrupt(void) __interrupt(0x0b)
+{
+    unsigned char c;
+    unsigned char pending;
+
+    /* reset IRQ pending flag */
+    P0IF &= ~0x08;
+
+    if( KBCSTS & KBC_STS_IBF )
+    {
+        if( KBCSTS & KBC_STS_CMD )
+        {
+            /* port 0x64, controller command. Cancels a pending one */
+            c = KBCCMD;
+            KBCCIF = KBC_CIF_IBF;
+            kbc_pending = 0;
+
+            switch( c )
+            {
+                case 0x20: /* read command byte */
+                    KBC_PUT(KBCCB, 0);
+                    break;
+                case 0x60: /* write command byte */
+                case 0xd1: /* write output port */
+                case 0xd2: /* write keyboard output buffer */
+                case 0xd3: /* write aux output buffer */
+                case 0xd4: /* write to aux device */
+                    kbc_pending = c;
+                    break;
+                case 0xa7: /* disable aux interface */
+                    KBCCB |= KBC_CB_AUX_OFF;
+                    break;
+                case 0xa8: /* enable aux interface */
+                    KBCCB &= ~KBC_CB_AUX_OFF;
+                    break;
+                case 0xa9: /* test aux interface */
+                case 0xab: /* test keyboard interface */
+                    KBC_PUT(0x00, 0);
+                    break;
+                case 0xaa: /* self test */
+                    KBC_PUT(0x55, 0);
+                    break;
+                case 0xad: /* disable keyboard interface */
+                    KBCCB |= KBC_CB_KBD_OFF;
+                    break;
+                case 0xae: /* enable keyboard interface */
+                    KBCCB &= ~KBC_CB_KBD_OFF;
+                    break;
+                case 0xc0: /* read input port */
+                case 0xd0: /* read output port */
+                    KBC_PUT(0x00, 0);
+                    break;
+                default:
+                    /* 0xfe (pulse reset) and others are ignored.
+                       Host reset is not wired to the KBC block */
+                    break;
+            }
+        }
+        else
+        {
+            /* port 0x60, data */
+            c = KBCDAT;
+            KBCCIF = KBC_CIF_IBF;
+            pending = kbc_pending;
+            kbc_pending = 0;
+
+            switch( pending )
+            {
+                case 0x60:
+                    KBCCB = c;
+                    break;
+                case 0xd1: /* A20 and host reset, ignored */
+                    break;
+                case 0xd2:
+                    KBC_PUT(c, 0);
+                    break;
+                case 0xd3:
+                    KBC_PUT(c, KBC_STS_AUX);
+                    break;
+                case 0xd4:
+                    /* sent by handle_ps2(), the reply comes from the device */
+                    kbc_aux_out = c;
+                    kbc_aux_out_pending = 1;
+                    busy = 1;
+                    break;
+                default:
+                    /* keyboard command or its argument. Sent by handle_ps2(),
+                       the reply comes from the keyboard. Writing to the
+                       keyboard enables its interface */
+                    KBCCB &= ~KBC_CB_KBD_OFF;
+                    if( kbc_kbd_arg )
+                    {
+                        if( kbc_kbd_arg == 0xf0 && c )
+                            kbc_kbd_set = c;
+                        kbc_kbd_arg = 0;
+                    }
+                    else
+                    {
+                        switch( c )
+                        {
+                            case 0xed: /* LED bits */
+                            case 0xf0: /* scan code set */
+                            case 0xf3: /* typematic rate */
+                                kbc_kbd_arg = c;
+                                break;
+                            case 0xf4: /* enable scanning */
+                                kbc_scanning = 1;
+                                break;
+                            case 0xf5: /* disable scanning */
+                                kbc_scanning = 0;
+                                break;
+                            case 0xff: /* reset, drops pending keycodes */
+                                kbc_head = kbc_tail;
+                                kbc_kbd_set = 2;
+                                kbc_kbd_break = 0;
+                                kbc_kbd_partial = 0;
+                                kbc_scanning = 1;
+                                break;
+                        }
+                    }
+                    kbc_kbd_out = c;
+                    kbc_kbd_out_pending = 1;
+                    busy = 1;
+                    break;
+            }
+        }
+        STATES_UPDATE(keyboard, kbc_pending);
+    }
+
+    KBC_SEND_NEXT();
+}
+
+
+//! State machine that completely handles keyboard input
+/*! Moves the make/break codes of the 3x3 matrix into the KBC queue
+    while the host has keyboard and scanning enabled. The codes are
+    set 1 codes. They are passed on untranslated while KBC_CB_XLATE
+    is set, else converted to set 2 (break codes get 0xf0) unless
+    the keyboard has been switched to set 1.
+    Codes are not split: a code is only moved if all its bytes fit,
+    and not while the keyboard is in the middle of a code.
+    \return - not zero if there is work to be done.
+ */
+bool handle_keyboard_in(void)
+{
+    bool moved = 0;
+
+    while( !KEYCODE_FIFO_EMPTY() && kbc_scanning && !kbc_kbd_partial &&
+           !(KBCCB & KBC_CB_KBD_OFF) )
+    {
+        unsigned char t;
+        unsigned char c;
+
+        /* port 0x6c command 0x48 may read the FIFO as well */
+        HOST_INTERFACE_INTERRUPT_DISABLE;
+        KBC_INTERRUPT_DISABLE;
+
+        t = cursors.tail;
+        if( cursors.head == t || KBC_FREE() < 3 )
+        {
+            KBC_INTERRUPT_ENABLE;
+            HOST_INTERFACE_INTERRUPT_ENABLE;
+            break;
+        }
+
+        c = cursors.keycode[t].code[0];
+        if( c == 0xe0 )
+        {
+            KBC_PUT(0xe0, 0);
+            c = cursors.keycode[t].code[1];
+        }
+        if( !(KBCCB & KBC_CB_XLATE) && kbc_kbd_set != 1 )
+        {
+            if( c & 0x80 )
+                KBC_PUT(0xf0, 0);
+            c &= 0x7f;
+            if( c >= 0x64 && c <= 0x69 )
+                c = kbc_matrix_set2[c - 0x64];
+        }
+        KBC_PUT(c, 0);
+        cursors.tail = (unsigned char)(t + 1) & (KEYCODE_FIFO - 1);
+
+        KBC_SEND_NEXT();
+
+        KBC_INTERRUPT_ENABLE;
+        HOST_INTERFACE_INTERRUPT_ENABLE;
+
+        moved = 1;
+    }
+
+    return moved;
+}
+
+
+//! queue bytes from the PS/2 devices
+/*! All or nothing, so mouse packets reach the host as a unit.
+    \return - zero if there was no space
+ */
+bool kbc_put(unsigned char __xdata *p, unsigned char len, unsigned char aux)
+{
+    KBC_INTERRUPT_DISABLE;
+
+    if( KBC_FREE() < len )
+    {
+        KBC_INTERRUPT_ENABLE;
+        return 0;
+    }
+
+    while( len-- )
+    {
+        KBC_PUT(*p, aux);
+        p++;
+    }
+
+    KBC_SEND_NEXT();
+
+    KBC_INTERRUPT_ENABLE;
+
+    return 1;
+}
+
+
+//! queue a byte from the keyboard
+/*! The keyboard sends set 2 codes. While KBC_CB_XLATE is set they
+    are translated to set 1 as an i8042 does: the break prefix 0xf0
+    is swallowed and sets bit 7 of the next byte.
+    \return - zero if there was no space
+ */
+bool kbc_put_keyboard(unsigned char c)
+{
+    bool partial = (c == 0xe0 || c == 0xe1 || c == 0xf0);
+
+    if( KBCCB & KBC_CB_XLATE )
+    {
+        if( c == 0xf0 )
+        {
+            kbc_kbd_break = 1;
+            kbc_kbd_partial = 1;
+            return 1;
+        }
+        if( c < sizeof kbc_xlate )
+            c = kbc_xlate[c];
+        if( kbc_kbd_break )
+            c |= 0x80;
+    }
+
+    KBC_INTERRUPT_DISABLE;
+
+    if( !KBC_FREE() )
+    {
+        KBC_INTERRUPT_ENABLE;
+        return 0;
+    }
+
+    KBC_PUT(c, 0);
+    KBC_SEND_NEXT();
+
+    kbc_kbd_break = 0;
+    kbc_kbd_partial = partial;
+
+    KBC_INTERRUPT_ENABLE;
+
+    return 1;
+}
@@ -0,0 +1,65 @@
+/*-------------------------------------------------------------------------
+   kbc.h - i8042 compatible keyboard controller on the KBC block
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include "chip.h"
+
+#define KBC_INTERRUPT_ENABLE  do{ P0IE |=  0x08; } while(0)
+#define KBC_INTERRUPT_DISABLE do{ P0IE &= ~0x08; } while(0)
+
+//! number of bytes queued towards the host (power of 2)
+#define KBC_QUEUE (16)
+
+/* i8042 status register bits as seen by the host at port 0x64 */
+#define KBC_STS_OBF  (0x01)
+#define KBC_STS_IBF  (0x02)
+#define KBC_STS_SYS  (0x04)
+#define KBC_STS_CMD  (0x08)  /**< last write was to port 0x64 */
+#define KBC_STS_AUX  (0x20)  /**< output buffer holds aux (mouse) data */
+
+/* i8042 command byte bits */
+#define KBC_CB_KBD_INT   (0x01)
+#define KBC_CB_AUX_INT   (0x02)
+#define KBC_CB_SYS       (0x04)
+#define KBC_CB_KBD_OFF   (0x10)
+#define KBC_CB_AUX_OFF   (0x20)
+#define KBC_CB_XLATE     (0x40)
+
+//! byte the host wants to send to the aux device (i8042 command 0xd4)
+extern volatile unsigned char __pdata kbc_aux_out;
+extern volatile bool kbc_aux_out_pending;
+
+//! byte the host wants to send to the keyboard (port 0x60)
+extern volatile unsigned char __pdata kbc_kbd_out;
+extern volatile bool kbc_kbd_out_pending;
+
+void kbc_init(void);
+
+bool handle_keyboard_in(void);
+
+bool kbc_put(unsigned char __xdata *p, unsigned char len, unsigned char aux);
+
+bool kbc_put_keyboard(unsigned char c);
+
+void kbc_interrupt(void) __interrupt(0x0b);
@@ -0,0 +1,68 @@
+/*-------------------------------------------------------------------------
+   log.c - compact binary debug records
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include "chip.h"
+#include "log.h"
+#include "timer.h"
+#include "uart.h"
+
+#if defined(SDCC)
+
+static void put_u16(unsigned int i)
+{
+    putchar((unsigned char)i);
+    putchar((unsigned char)(i >> 8));
+}
+
+//! send one binary debug record
+/*! \see log.h for the format
+ */
+void log_record(unsigned int id, unsigned char n, unsigned int a, unsigned int b, unsigned int c)
+{
+    putchar(LOG_RECORD_MARK | n);
+    put_u16(id);
+    if( !(n & LOG_RECORD_NO_TICK) )
+        put_u16(get_tick());
+    n &= 0x03;
+
+    if( n > 0 )
+        put_u16(a);
+    if( n > 1 )
+        put_u16(b);
+    if( n > 2 )
+        put_u16(c);
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*-------------------------------------------------------------------------
+   log.h - compact binary debug records
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+/*! Instead of formatting text on the EC a LOGn() call sends a small
+    binary record over the UART:
+
+      byte 0    LOG_RECORD_MARK | number of arguments (0..3)
+                (| LOG_RECORD_NO_TICK for SLOGn())
+      byte 1,2  id (little endian), (LOG_MODULE << 11) | __LINE__
+      byte 3,4  tick (little endian), not sent by SLOGn()
+      then      one 16 bit argument each (little endian)
+
+    SLOGn() is for output that is not worth a timestamp (dumps,
+    replies to monitor commands). With the 2 bytes saved it also
+    pays for formats of only a few characters.
+
+    The format string never makes it into the image. The build
+    collects it into openec.logtab (see tools/logdecode.py) and the
+    host side decoder turns the record back into text.
+    Text output and records can be mixed on the line, text bytes
+    are always below LOG_RECORD_MARK.
+
+    Each file using LOGn() defines LOG_MODULE (one of the numbers below)
+    before including this file, has less than 2048 lines and has at most
+    one LOGn() or SLOGn() per line. The format string has to be a literal on the
+    same line as LOGn. Arguments are 16 bit, use %d, %u, %x or %c.
+
+    Compiled with gcc the format string is simply passed to printf.
+ */
+
+#define LOG_MODULE_MONITOR (1)
+#define LOG_MODULE_DS2756  (2)
+
+#define LOG_RECORD_MARK (0xf0)
+#define LOG_RECORD_NO_TICK (0x04)
+
+#if defined(SDCC)
+
+#define LOG_ID (((unsigned int)LOG_MODULE << 11) | __LINE__)
+
+#define LOG0(fmt)         log_record(LOG_ID, 0, 0, 0, 0)
+#define LOG1(fmt,a)       log_record(LOG_ID, 1, (a), 0, 0)
+#define LOG2(fmt,a,b)     log_record(LOG_ID, 2, (a), (b), 0)
+#define LOG3(fmt,a,b,c)   log_record(LOG_ID, 3, (a), (b), (c))
+
+#define SLOG0(fmt)        log_record(LOG_ID, LOG_RECORD_NO_TICK | 0, 0, 0, 0)
+#define SLOG1(fmt,a)      log_record(LOG_ID, LOG_RECORD_NO_TICK | 1, (a), 0, 0)
+#define SLOG2(fmt,a,b)    log_record(LOG_ID, LOG_RECORD_NO_TICK | 2, (a), (b), 0)
+#define SLOG3(fmt,a,b,c)  log_record(LOG_ID, LOG_RECORD_NO_TICK | 3, (a), (b), (c))
+
+void log_record(unsigned int id, unsigned char n, unsigned int a, unsigned int b, unsigned int c);
+
+#else
+
+/* not <stdio.h>, its putchar() differs from ours */
+extern int printf(const char *fmt, ...);
+
+#define LOG0(fmt)         printf(fmt)
+#define LOG1(fmt,a)       printf(fmt, (int)(a))
+#define LOG2(fmt,a,b)     printf(fmt, (int)(a), (int)(b))
+#define LOG3(fmt,a,b,c)   printf(fmt, (int)(a), (int)(b), (int)(c))
+
+#define SLOG0(fmt)        LOG0(fmt)
+#define SLOG1(fmt,a)      LOG1(fmt,a)
+#define SLOG2(fmt,a,b)    LOG2(fmt,a,b)
+#define SLOG3(fmt,a,b,c)  LOG3(fmt,a,b,c)
+
+#endif
@@ -103,11 +103,16 @@
 #include <stdbool.h>
 #include "chip.h"
 #include "adc.h"
+#include "bank.h"
 #include "battery.h"
 #include "build.h"
 #include "charge_sched.h"
+#include "flash.h"
+#include "flash_prog.h"
+#include "history.h"
 #include "one_wire.h"
 #include "idle.h"
+#include "kbc.h"
 #include "led.h"
 #include "matrix_3x3.h"
 #include "manufacturing.h"
@@ -115,9 +120,11 @@
 #include "one_wire.h"
 #include "power.h"
 #include "port_0x6c.h"
+#include "ps2.h"
 #include "sfr_dump.h"
 #include "states.h"
 #include "timer.h"
+#include "trace.h"
 #include "uart.h"
 #include "unused_irq.h"
 #include "watchdog.h"
@@ -139,7 +146,7 @@ unsigned char _sdcc_external_startup(void)
     XBICFG = 0x64;      /**< as dumped by ec-dump.fth */
     XBICS |= 0x30;      /**< bit 5 as dumped by ec-dump.fth, Enable Reset 8051 and XBI Segment Setting */
 #if 1
-    CLKCFG = 0x94;      /**< as dumped by ec-dump.fth */
+    CLKCFG = 0x94;      /**< as dumped by ec-dump.fth. main() tries 0xd4 in flash_clock_init() */
 #else
     CLKCFG = 0xd4;      /**< WARNING: setting bit 6 here is out of specification for
                              the Spansion S25FL008A. It is unstable here yet it worked long enough
@@ -177,14 +184,6 @@ unsigned char _sdcc_external_startup(void)
 }
 
 
-//! State machine that completely handles keyboard input
-/*! feeds input characters into a short input event buffer.
- */
-bool handle_keyboard_in(void)
-{
-    return 0;
-}
-
 //! Communication from/to the main processor 
 /*! Unfortunately the EC is not completely self contained. 
     Someone with much more CPU power might have a request. 
@@ -192,7 +191,21 @@ bool handle_keyboard_in(void)
  */
 bool handle_command(void)
 {
-    return 0;
+    unsigned char c = host_deferred_command;
+
+    if( !c )
+        return 0;
+
+    host_deferred_command = 0;
+
+    switch( c )
+    {
+        case 0x40:
+            history_drain_to_host( c );
+            break;
+    }
+
+    return 1;
 }
 
 
@@ -237,7 +250,6 @@ void handle_debug(void)
             dump_mcs51();
             dump_xdata_sfr();
         }
-        cursors.keycode_updated = 0; // hack
     }
 
     /* does current state of this bit differ from the state that was last seen */
@@ -249,9 +261,17 @@ void handle_debug(void)
         {
             dump_gpio();
         }
-        cursors.keycode_updated = 0; // hack
     }
 
+    /* if the host reads the keycodes neither through the KBC nor
+       through port 0x6c command 0x48 drop the oldest so game_key_status keeps following the keys */
+    if( cursors.overflow &&
+        ((unsigned char)(cursors.head + 1) & (KEYCODE_FIFO - 1)) == cursors.tail )
+    {
+        HOST_INTERFACE_INTERRUPT_DISABLE;
+        cursors.tail = (unsigned char)(cursors.tail + 1) & (KEYCODE_FIFO - 1);
+        HOST_INTERFACE_INTERRUPT_ENABLE;
+    }
 }
 
 
@@ -291,14 +311,24 @@ void startup_message(void)
 //! You expected it: This routine is expected never to exit
 void main (void)
 {
+    bank_init();
+    trace_init();
     port_init();
     watchdog_init();
+    flash_clock_init();
     timer_gpt3_init();
     adc_init();
     cursors_init();
     power_init();
+    history_init();
+    manufacturing_index_init();
+    host_interface_init();
+    kbc_init();
+    ps2_init();
 
     uart_init();
+    charge_pwm_init();
+    flash_prog_init();
 
     /* enable interrupts. */
     EA = 1;
@@ -327,6 +357,9 @@ tx_drain();  // oops, UART routines seem not yet clean
     timer1_init();
     battery_charging_table_init();
 
+    /* verify the image we are running from (in the background) */
+    flash_checksum_start( flash_running_page() );
+
     LED_CHG_G_OFF();
     LED_CHG_R_OFF();
     LED_PWR_OFF();
@@ -354,14 +387,24 @@ tx_drain();  // oops, UART routines seem not yet clean
 
         busy = handle_command();
         busy |= handle_cursors();
+        busy |= handle_keyboard_in();
+        busy |= handle_ps2();
         handle_leds();
         handle_power();
+        handle_battery();
         handle_ds2756_requests();
         handle_ds2756_readout();
         busy |= handle_battery_charging_table();
+        busy |= handle_flash_checksum();
+        handle_flash_clock();
+        busy |= handle_flash_prog();
 
         watchdog_all_up_and_well |= WATCHDOG_MAIN_LOOP_IS_FINE;
 
+#if PROFILE
+        profile_passes++;
+#endif
+
         print_states();
 
         monitor();
@@ -46,14 +46,22 @@
 
 __pdata tagtype tag;
 
+static struct flash_stream_type __xdata stream;
 
-unsigned char manufacturing_read_byte(unsigned int address)
+struct manufacturing_index_type __xdata manufacturing_index;
+unsigned char __xdata manufacturing_index_size;
+
+//! set if the index holds all tags
+static bool index_complete;
+
+
+unsigned char manufacturing_read_byte(unsigned int address) __banked
 {
     return flash_read_byte(0x0e, address);
 }
 
 
-bool manufacturing_get_first_tag()
+bool manufacturing_get_first_tag() __banked
 {
     tag.len = 0;
     tag.data_address = 0x0000; /* address of data byte (if any) */
@@ -62,17 +70,20 @@ bool manufacturing_get_first_tag()
 }
 
 
-bool manufacturing_get_next_tag()
+bool manufacturing_get_next_tag() __banked
 {
+    static unsigned char __xdata header[4];
     unsigned int address;
     unsigned char len, len_cpl;
 
-    address = tag.data_address;
+    /* len_cpl, len, name[0], name[1] are just below the data */
+    address = tag.data_address - sizeof header;
+    flash_read_block( 0x0e, address, header, sizeof header );
 
-    tag.name[1] = manufacturing_read_byte( --address );
-    tag.name[0] = manufacturing_read_byte( --address );
-    len         = manufacturing_read_byte( --address );
-    len_cpl     = manufacturing_read_byte( --address );
+    len_cpl     = header[0];
+    len         = header[1];
+    tag.name[0] = header[2];
+    tag.name[1] = header[3];
 
     if( (len & 0x80) ||
         (len ^ len_cpl) != 0xff )
@@ -90,7 +101,7 @@ bool manufacturing_get_next_tag()
 }
 
 
-void manufacturing_print_tag()
+void manufacturing_print_tag() __banked
 {
     unsigned char i,c;
 
@@ -99,9 +110,10 @@ void manufacturing_print_tag()
     putspace();
     putchar('"');
 
+    flash_stream_open( &stream, 0x0e, tag.data_address );
     for( i = 0; i < tag.len; i++ )
     {
-        c = manufacturing_read_byte( tag.data_address + i );
+        c = flash_stream_get( &stream );
         if( isprint(c) )
             putchar(c);
         else
@@ -115,7 +127,7 @@ void manufacturing_print_tag()
 }
 
 
-void manufacturing_print_all()
+void manufacturing_print_all() __banked
 {
     if( manufacturing_get_first_tag() )
     {
@@ -129,11 +141,52 @@ void manufacturing_print_all()
 }
 
 
-bool manufacturing_find_tag( unsigned char __code * ptr )
+//! walk the tag chain once and remember where the tags are
+void manufacturing_index_init() __banked
+{
+    unsigned char n = 0;
+
+    index_complete = 0;
+
+    if( manufacturing_get_first_tag() )
+    {
+        do
+        {
+            if( n == MANUFACTURING_INDEX_MAX )
+                break;
+            manufacturing_index.tag[n++] = tag;
+        } while( manufacturing_get_next_tag() );
+    }
+
+    if( n < MANUFACTURING_INDEX_MAX )
+        index_complete = 1;
+
+    manufacturing_index.num = n;
+    manufacturing_index_size = 1 + n * sizeof(tagtype);
+}
+
+
+//! look up a tag, on success it is in \see tag
+bool manufacturing_find_tag( unsigned char __code * ptr ) __banked
 {
     unsigned char n0 = *ptr++;
     unsigned char n1 = *ptr;
+    unsigned char i;
+
+    for( i = 0; i < manufacturing_index.num; i++ )
+    {
+        if( manufacturing_index.tag[i].name[0] == n0 &&
+            manufacturing_index.tag[i].name[1] == n1 )
+        {
+            tag = manufacturing_index.tag[i];
+            return 1;
+        }
+    }
+
+    if( index_complete )
+        return 0;
 
+    /* more tags than the index holds */
     if( manufacturing_get_first_tag() )
     {
         do
@@ -31,10 +31,25 @@ typedef struct
 
 extern __pdata tagtype tag;
 
-unsigned char manufacturing_read_byte(unsigned int address);
-
-bool manufacturing_get_first_tag();
-bool manufacturing_get_next_tag();
-bool manufacturing_find_tag( unsigned char __code * ptr );
-void manufacturing_print_tag();
-void manufacturing_print_all();
+//! number of tags in the index (1 + 25 * 5 bytes fit into one host transfer)
+#define MANUFACTURING_INDEX_MAX (25)
+
+//! all tags, found once at boot
+/*! sent as is to the host (port 0x6c command 0x43) */
+struct manufacturing_index_type {
+    unsigned char num;
+    tagtype tag[MANUFACTURING_INDEX_MAX];
+};
+
+extern struct manufacturing_index_type __xdata manufacturing_index;
+extern unsigned char __xdata manufacturing_index_size;  /**< bytes used in manufacturing_index */
+
+/* these live in the banked code segment, see bank.c */
+unsigned char manufacturing_read_byte(unsigned int address) __banked;
+
+void manufacturing_index_init() __banked;
+bool manufacturing_get_first_tag() __banked;
+bool manufacturing_get_next_tag() __banked;
+bool manufacturing_find_tag( unsigned char __code * ptr ) __banked;
+void manufacturing_print_tag() __banked;
+void manufacturing_print_all() __banked;
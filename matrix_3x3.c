@@ -33,12 +33,25 @@
 -------------------------------------------------------------------------*/
 #include <stdbool.h>
 #include "chip.h"
+#include "idle.h"
 #include "states.h"
 #include "timer.h"
 #include "matrix_3x3.h"
 
 #define UPDATE_GAME_KEY_STATUS 1
 
+//! wake up from a key going down by GPIO IRQ, see keypad_interrupt()
+/*! Off until the GPWU..E0 registers and IRQ 0x1b are confirmed.
+    Until then the idle keypad is polled every KEYPAD_POLL_TICKS,
+    which is cheaper than scanning but not the zero CPU idle asked for. */
+#define KEYPAD_WAKE (0)
+
+//! ticks between two looks at the idle keypad (a press lasts far longer)
+#define KEYPAD_POLL_TICKS (8)
+
+//! KEY_IN_1..3 are GPIOE04..06
+#define KEY_IN_MASK (0x70)
+
 //! bit mask for keys within game_key_status
 #define KEY_LF_R  0x02
 #define KEY_RT_R  0x04
@@ -57,6 +70,9 @@
 struct cursors __pdata cursors;
 
 //! keeps the not externally visible data to handle the 3x3 matrix
+/*! The 9 keys are bits 0..8 (bit 3 * column + n - 1 for KEY_IN_n),
+    so the debouncer handles all keys with a few byte operations.
+ */
 static struct
 {
     /* stores (low byte of) tick the scanning routine was last called
@@ -65,23 +81,88 @@ static struct
      */
     unsigned char ctick;
 
-    /* column of the matrix
-       schematic names them 1..3. This variable counts 0..2 
-     */
-    unsigned char column;
+    /* vertical counter, bit slices of a 2 bit release counter per key */
+    unsigned int cnt0;
+    unsigned int cnt1;
 
-    /* a mirror of the keyboard matrix.
-       Not as it is but rather the state we have reacted upon 
-     */
-    unsigned char row[3];
+    /* debounced state of the keys */
+    unsigned int debounced;
 
-    /* used for debouncing.
-       lower nibble holds previous reading,
-       higher nibble might hold the one before 
-     */
-    unsigned char row_raw[3];
+    /* state of the keys that has been queued as make/break codes.
+       Lags behind debounced while the FIFO is full */
+    unsigned int reported;
+
+    /* not scanning, all columns driven low waiting for a key */
+    unsigned char waiting;
 } __pdata cursors_private;
 
+//! make code per key, the break code has bit 7 set
+/*! copy and paste from the wiki (20070718), see handle_cursors() */
+static const struct
+{
+    unsigned char prefix;       /**< 0xe0 or 0x00 */
+    unsigned char code;
+} __code keypad_code[9] =
+{
+    {0x00, 0x68},   /* column 0 KEY_IN_1: KEY_RT_L */
+    {0x00, 0x67},   /*          KEY_IN_2: KEY_LF_L */
+    {0x00, 0x66},   /*          KEY_IN_3: KEY_DN_L */
+    {0x00, 0x65},   /* column 1 KEY_IN_1: KEY_UP_L */
+    {0xe0, 0x68},   /*          KEY_IN_2: KEY_RT_R */
+    {0xe0, 0x67},   /*          KEY_IN_3: KEY_LF_R */
+    {0xe0, 0x66},   /* column 2 KEY_IN_1: KEY_DN_R */
+    {0xe0, 0x65},   /*          KEY_IN_2: KEY_UP_R */
+    {0x00, 0x69},   /*          KEY_IN_3: KEY_COLOR */
+};
+
+#if UPDATE_GAME_KEY_STATUS
+//! bit within game_key_status (as transmitted by port 0x6c command 0x1d) per key
+static const unsigned int __code keypad_game_key[9] =
+{
+    KEY_RT_L, KEY_LF_L, KEY_DN_L,
+    KEY_UP_L, KEY_RT_R, KEY_LF_R,
+    KEY_DN_R << 8, KEY_UP_R << 8, KEY_COLOR
+};
+#endif
+
+//! queue the make or break code of a key
+/*! \return 0 if the FIFO is full (the change should be tried again) */
+static bool keycode_put(unsigned char key, bool make)
+{
+    unsigned char h = cursors.head;
+    unsigned char next = (unsigned char)(h + 1) & (KEYCODE_FIFO - 1);
+    unsigned char c;
+
+    if( next == cursors.tail )
+    {
+        cursors.overflow = 1;
+        return 0;
+    }
+
+    c = keypad_code[key].code;
+    if( !make )
+        c |= 0x80;
+
+    if( keypad_code[key].prefix )
+    {
+        cursors.keycode[h].code[0] = keypad_code[key].prefix;
+        cursors.keycode[h].code[1] = c;
+    }
+    else
+    {
+        cursors.keycode[h].code[0] = c;
+        cursors.keycode[h].code[1] = 0x00;
+    }
+    cursors.keycode[h].tick = get_tick();
+    cursors.head = next;
+
+    return 1;
+}
+
+
+//! set by keypad_interrupt()
+static volatile __bit keypad_woken;
+
 
 
 void cursors_init( void )
@@ -109,6 +190,47 @@ void cursors_init( void )
 
 
 
+//! a KEY_IN_n went low while all columns were driven low
+/*! Only the first edge is of interest, scanning takes over then.
+    The IRQ number and the GPWU..E0 registers are unconfirmed.
+ */
+void keypad_interrupt(void) __interrupt(0x1b)
+{
+    GPWUENE0 &= ~KEY_IN_MASK;
+    GPWUPFE0 = KEY_IN_MASK;     /**< write 1 to clear? */
+    P3IF &= ~0x08;
+
+    keypad_woken = 1;
+    busy = 1;
+}
+
+
+//! drive all columns and stop scanning until a key goes down
+/*! Called with all keys released and debounced. Note that
+    KEY_OUT_3 is ISP_CLK, an attached debricking adapter now works
+    against it all the time (not only 1/3 of the time).
+ */
+static void keypad_wait(void)
+{
+    cursors_private.waiting = 1;
+    keypad_woken = 0;
+
+    GPIOD10 &= ~0xe0;
+
+#if KEYPAD_WAKE
+    GPWUPSE0 &= ~KEY_IN_MASK;   /**< falling edge */
+    GPWUELE0 &= ~KEY_IN_MASK;   /**< edge triggered */
+    GPWUPFE0 = KEY_IN_MASK;
+    GPWUENE0 |= KEY_IN_MASK;
+    P3IE |= 0x08;
+#endif
+
+    /* a key which went down while we set up would be missed */
+    if( ((unsigned char)~GPIOEIN0 & KEY_IN_MASK) )
+        keypad_woken = 1;
+}
+
+
 #ifdef SDCC
 # pragma callee_saves debug_toggle
 #endif
@@ -136,14 +258,59 @@ void debug_toggle(void)
 }
 
 
+//! reads all 9 keys, 1 is pressed
+/*! Selects each column in turn (columns 0,1,2 are on bit 6,7,5)
+    and leaves them deselected.
+ */
+static unsigned int keypad_read(void)
+{
+    const unsigned char __code column_GPIOD10[3] = {~0x40,~0x80,~0x20};
+    unsigned int raw = 0;
+    unsigned char column = 3;
+
+    do
+    {
+        column--;
+
+        /* non atomic access. Unless we protect this, no IRQ might
+           write to GPIOD10 */
+        GPIOD10 = (GPIOD10 | 0xe0) & column_GPIOD10[column];
+
+        /* short delay to allow the scan lines to be charged
+           via the 10k pullup (time constant in the order of
+           microseconds expected. Can someone send an oscillocope
+           screenshot and/or measure capacity of KEY_IN_1..3?) */
+        {
+            volatile unsigned char counter = 10;
+            while( --counter )
+                ;
+        }
+
+        /* reading input, inverting, ignore Power_Button */
+        raw = (raw << 3) | (((unsigned char)~GPIOEIN0 >> 4) & 0x07);
+    } while( column );
+
+    GPIOD10 |= 0xe0;
+
+    return raw;
+}
+
+
 //! Handles input from 3x3 matrix
 /*! see also http://wiki.laptop.org/index.php?title=Ec_specification
  *
- * This routine only reacts on a single key change.
- * If more than one key is changed (can you really
- * press keys more quickly than this routine is called?)
- * then the other key changes are handled within the
- * next calls of this routine.
+ * While no key is pressed and all changes are handled the
+ * matrix is not scanned, see keypad_wait(). Without KEYPAD_WAKE
+ * the inputs are then looked at every KEYPAD_POLL_TICKS only.
+ *
+ * All 9 keys are read each tick and debounced together. A key
+ * going down is taken at once (contacts do not close by themselves),
+ * a release only after 4 consecutive readings as released (about
+ * 40 ms, vertical counter), so bouncing never gives a second make.
+ * Every changed key is queued in cursors.keycode[] (scanning
+ * goes on while the host drains it). A change that does not fit
+ * into the FIFO is not acknowledged and is queued later,
+ * so no transition is dropped.
  *
  * copy and paste from the wiki (20070718) :
  *  Key matrix       	 Make code      	 Break code
@@ -159,235 +326,99 @@ void debug_toggle(void)
  *
  *  This code is untested and unlikely to contain no bugs.
  *
- *  Resources:
- *  0x01a1 byte code memory (0.6% of code memory),
- *  0      bytes data memory,
- *  0      bytes overlayable data memory,
- *  14     bytes pdata memory,
- *  xx/yy/zz cycles (best/typ/worst case)
- *
- *  \return TRUE if a change in the matrix is detected
+ *  \return TRUE if a change in the matrix was queued
  */
-
 bool handle_cursors(void)
 {
-    unsigned char column;
-    unsigned char in;
-    unsigned char in_debounced;
-
-    unsigned int keycode;
-    unsigned char row;
-
-    //! keycodes
-    const unsigned int __code keyin1_make[3]  = {0x6800, 0x6500, 0xe066};
-    const unsigned int __code keyin1_break[3] = {0xe800, 0xe500, 0xe0e6};
-    const unsigned int __code keyin2_make[3]  = {0x6700, 0xe068, 0xe065};
-    const unsigned int __code keyin2_break[3] = {0xe700, 0xe0e8, 0xe0e5};
-    const unsigned int __code keyin3_make[3]  = {0x6600, 0xe067, 0x6900};
-    const unsigned int __code keyin3_break[3] = {0xe600, 0xe0e7, 0xe900};
-
-    //! columns 0,1,2 are on bit 6,7,5
-    const unsigned char __code column_GPIOD10[3] = {~0x40,~0x80,~0x20};
+    unsigned int raw;
+    unsigned int delta;
+    unsigned int pending;
+    unsigned int bit;
+    unsigned char key;
+    bool news = 0;
+
+    if( cursors_private.waiting )
+    {
+        /* in case the wake-up IRQ does not come, look now and then */
+        if( !keypad_woken &&
+            (unsigned char)((unsigned char)tick - cursors_private.ctick) >= KEYPAD_POLL_TICKS )
+        {
+            cursors_private.ctick = (unsigned char)tick;
+            if( ((unsigned char)~GPIOEIN0 & KEY_IN_MASK) )
+                keypad_woken = 1;
+        }
 
+        if( !keypad_woken )
+            return 0;
+
+        /* scan right now */
+#if KEYPAD_WAKE
+        P3IE &= ~0x08;
+        GPWUENE0 &= ~KEY_IN_MASK;
+#endif
+        GPIOD10 |= 0xe0;
+        cursors_private.waiting = 0;
+    }
     /* do not want to be called twice per tick */
-    if( cursors_private.ctick == (unsigned char)tick )
+    else if( cursors_private.ctick == (unsigned char)tick )
         return 0;
     cursors_private.ctick = (unsigned char)tick;
 
-    /* previous keycode still not transmitted to host? */
-    if( cursors.keycode_updated )
-    {
-        /* Tempting: Try to send now. I think this should
-           not be done here, because it would be a hack 
-           (mixing two completely different functionalities). 
-         */
-        return 0;
-    }
+    raw = keypad_read();
 
-    /* read column number 0..2 into local variable */
-    column = cursors_private.column;
-
-    /* reading input, inverting, ignore Power_Button
-       Note: this read would not need be valid if done
-       immediately after selecting a new scan column.
-       If previously held low the capacity of the scan
-       lines (xxx pF?) needs to be charged via a
-       10k pullup resistor so a time constant in the 
-       order of microseconds is expected.
-       (Will not be critical here but nevertheless:
-       can someone send an oscillocope screenshot
-       and/or measure capacity of KEY_IN_1..3?)
-     */
-    in = ((unsigned char)~GPIOEIN0 >> 4) & 0x07;
-
-    /* do some debouncing.
-       The way it is done here ensures that a "Make" transition
-       is noticed immediately, whereas a "Break" condition needs
-       three consequtive consistent readings to be noticed.
-       Can the maximum bouncing time of the switches be specified?
-     */
-    in_debounced = in | 
-                   cursors_private.row_raw[column] | 
-                   ((cursors_private.row_raw[column]>>4)|cursors_private.row_raw[column]<<4);
-    in_debounced &= 0x07;
+    /* makes right away */
+    cursors_private.debounced |= raw;
 
-    /* shift previous raw value into high nibble,
-       low nibble gets the current value 
-     */
-    cursors_private.row_raw[column] = (cursors_private.row_raw[column] << 4) | in;
-
-    /* row is used often, have a local copy */
-    row = cursors_private.row[column];
+    /* vertical counter. Counts consecutive readings of a pressed
+       key as released, reset by a reading as pressed */
+    delta = ~raw & cursors_private.debounced;
+    cursors_private.cnt1 = (cursors_private.cnt1 ^ cursors_private.cnt0) & delta;
+    cursors_private.cnt0 = ~cursors_private.cnt0 & delta;
+    cursors_private.debounced &= ~(delta & ~(cursors_private.cnt0 | cursors_private.cnt1));
 
-    /* does it differ from what has been handled so far? */
-    if (row ^ in_debounced)
+    /* queue every key that differs from what has been handled so far */
+    pending = cursors_private.debounced ^ cursors_private.reported;
+    for( bit = 0x0001, key = 0; pending; bit <<= 1, key++ )
     {
-        /* find out which key has changed.
-           Deliberately handling _only_ the first
-           key where a change is detected. */
-        if( (row ^ in_debounced) & 0x01 )
-        {
-            /* track the value */
-            row ^= 0x01;
-            /* and prepare code to be sent */
-            if(row & 0x01)
-                keycode = keyin1_make[column];
-            else
-                keycode = keyin1_break[column];
-
-        }
-        else if( (row ^ in_debounced) & 0x02 )
-        {
-            row ^= 0x02;
-            if(row & 0x02)
-                keycode = keyin2_make[column];
-            else
-                keycode = keyin2_break[column];
-        }
-        else /* if is neither needed nor wanted */
-        {
-            row ^= 0x04;
-            if(row & 0x04)
-                keycode = keyin3_make[column];
-            else
-                keycode = keyin3_break[column];
-        }
+        if( !(pending & bit) )
+            continue;
+        pending &= ~bit;
 
-        /* & 0x07 is paranoia. */   
-        row &= 0x07;
-        /* write back from register to struct */
-        cursors_private.row[column] = row;
-
-        /* pass data to struct for later transmission */
-        cursors.keycode[0] = keycode>>8;
-        cursors.keycode[1] = keycode;
-        cursors.keycode[2] = 0x00; /* should be zero anyway, paranoia */
+        if( !keycode_put( key, cursors_private.debounced & bit ) )
+            break;
 
+        /* track the value */
+        cursors_private.reported ^= bit;
+        news = 1;
+    }
 
 #if UPDATE_GAME_KEY_STATUS
+    if( news )
+    {
+        unsigned int status = 0;
 
-        /* updating game_key_status.
-           (sending keycodes _and_ handling game_key_status) */
-        {
-            if( column == 0 )
-            {
-                /* the bit positions as transmitted by port 0x6c command 0x1d
-                   seem not a good match for the hardware. Doing a table lookup.
-                   Expect some bugs here:
-                 */
-                const unsigned char __code mask[8] =
-                {
-                                                 0,
-                                          KEY_RT_L,
-                               KEY_LF_L           ,
-                               KEY_LF_L | KEY_RT_L,
-                    KEY_DN_L                      ,
-                    KEY_DN_L |            KEY_RT_L,
-                    KEY_DN_L | KEY_LF_L           ,
-                    KEY_DN_L | KEY_LF_L | KEY_RT_L
-                };
-
-                /* using a temporary variable for the bit operations
-                   so no intermediate values for cursors.game_key_status
-                   can be seen.
-                 */
-                unsigned char tmp;
-
-                tmp = cursors.game_key_status[0];
-                tmp &= ~(KEY_RT_L | KEY_LF_L | KEY_DN_L);
-                tmp |= mask[row];
-                cursors.game_key_status[0] = tmp;
-            }
-            else if( column == 1)
-            {
-                const unsigned char __code mask[8] =
-                {
-                                                 0,
-                                          KEY_UP_L,
-                               KEY_RT_R           ,
-                               KEY_RT_R | KEY_UP_L,
-                    KEY_LF_R                      ,
-                    KEY_LF_R |            KEY_UP_L,
-                    KEY_LF_R | KEY_RT_R           ,
-                    KEY_LF_R | KEY_RT_R | KEY_UP_L
-                };
-                unsigned char tmp;
-
-                tmp = cursors.game_key_status[0];
-                tmp &= ~(KEY_UP_L | KEY_RT_R | KEY_LF_R);
-                tmp |= mask[row];
-                cursors.game_key_status[0] = tmp;
-            }
-            else
-            {
-                const unsigned char __code mask[4] =
-                {
-                                      0,
-                               KEY_DN_R,
-                    KEY_UP_R           ,
-                    KEY_UP_R | KEY_DN_R,
-                };
-                unsigned char tmp;
-
-                /* setting bit 7 accordingly */
-                tmp = cursors.game_key_status[0];
-                if(row&0x04)
-                    tmp |= KEY_COLOR;
-                else
-                    tmp &= ~KEY_COLOR;
-                cursors.game_key_status[0] = tmp;
-
-                /* setting bit 8 and bit 9 accordingly
-                  (and clearing bit 10..15) */
-                cursors.game_key_status[1] = mask[row];
-            }
-        }
-
-#endif
+        for( bit = 0x0001, key = 0; key < 9; bit <<= 1, key++ )
+            if( cursors_private.reported & bit )
+                status |= keypad_game_key[key];
 
-        /* News! Please transmit to host */
-        cursors.keycode_updated = 1;
+        /* the bit positions as transmitted by port 0x6c command 0x1d
+           seem not a good match for the hardware, hence the table.
+           Writing bytes, no intermediate values can be seen. */
+        cursors.game_key_status[0] = (unsigned char)status;
+        cursors.game_key_status[1] = (unsigned char)(status >> 8);
     }
-
-    /* advance to next column */
-    column++;
-    if(column == 3)
-       column = 0;
-
-    /* write local variable into struct */
-    cursors_private.column = column;
+#endif
 
     /* and to debugging area (if enabled) */
-    STATES_UPDATE(matrix_3x3, column | (cursors.keycode_updated?0x80:0x00));
+    STATES_UPDATE(matrix_3x3, (unsigned char)cursors_private.debounced | (KEYCODE_FIFO_EMPTY()?0x00:0x80));
 
     /* remove? */
 //    debug_toggle();
 
-    /* non atomic access. Unless we protect this, no IRQ might
-       write to GPIOD10 */
-    GPIOD10 = (GPIOD10 | 0xe0) & column_GPIOD10[column];
-
-    return cursors.keycode_updated;
+    /* all released and nothing left to debounce? */
+    if( !(raw | cursors_private.debounced | cursors_private.reported |
+          cursors_private.cnt0 | cursors_private.cnt1) )
+        keypad_wait();
 
+    return news;
 }
-
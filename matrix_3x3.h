@@ -22,29 +22,44 @@
    what you give them.   Help stamp out software-hoarding!
 -------------------------------------------------------------------------*/
 
+//! number of entries in the keycode FIFO (power of 2)
+#define KEYCODE_FIFO (8)
+
+//! a make or break code and when it was detected
+struct keycode_entry
+{
+    //! 0xe0 prefix or code, second byte is 0x00 for single byte codes
+    unsigned char code[2];
+    unsigned int tick;
+};
+
 //! keeps the externally visible data to handle the 3x3 matrix
 typedef struct cursors
 {
-    //! keycode we'd want to transmit to the host
-    unsigned char keycode[3];
+    //! keycodes we'd want to transmit to the host
+    struct keycode_entry keycode[KEYCODE_FIFO];
+
+    //! next entry written by handle_cursors()
+    unsigned char head;
+
+    //! next entry to transmit
+    /*! this is the only variable that is changed from "outside"
+        (by whoever transmits the keycodes, possibly from IRQ) */
+    volatile unsigned char tail;
+
+    //! set if a key change had to wait for space in the FIFO
+    unsigned char overflow;
 
     //! 9 bits of key status as transmitted to the host
     unsigned char game_key_status[2];
-    
-    // unsigned int keycode_timestamp;
-
-    //! Flag for handshaking
-    /*! If there's a new keycode this flag is set.
-        If transmitted another routine will reset this flag.
-        Note, this currently is the only variable that might
-        be changed from "outside" (from a routine that is
-        not within matrix_3x3.c)
-     */
-    unsigned int keycode_updated:1;
 };
 
+#define KEYCODE_FIFO_EMPTY() (cursors.head == cursors.tail)
+
 extern struct cursors __pdata cursors;
 
 extern bool handle_cursors(void);
 
 extern void cursors_init(void);
+
+extern void keypad_interrupt(void) __interrupt(0x1b);
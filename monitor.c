@@ -44,19 +44,38 @@
 #include "chip.h"
 #include "adc.h"
 #include "flash.h"
+#include "idle.h"
 #include "reset.h"
 #include "sfr_rw.h"
 #include "sfr_dump.h"
 #include "states.h"
 #include "temperature.h"
+#include "timer.h"
+#include "trace.h"
 #include "uart.h"
 
+#define LOG_MODULE LOG_MODULE_MONITOR
+#include "log.h"
+
 #define DEBUG 1
-#if DEBUG && defined(SDCC)
-# include <stdio.h>
-# define PRINTF(...) printf_tiny(__VA_ARGS__)     /* printf is just here for debugging */
-#else
-# define PRINTF(...)
+
+#if DEBUG
+//! a small signed number as text, shorter than a log record
+static void put_s8(signed char c)
+{
+    unsigned char u = c;
+
+    if( c < 0 )
+    {
+        putchar('-');
+        u = -c;
+    }
+    if( u >= 100 )
+        putchar('0' + u / 100);
+    if( u >= 10 )
+        putchar('0' + u / 10 % 10);
+    putchar('0' + u % 10);
+}
 #endif
 
 typedef enum 
@@ -67,6 +86,11 @@ typedef enum
     command_set,
     command_and,
     command_or,
+    command_check,
+    command_X,
+    command_dump,
+    command_verify,
+    command_passes,
     command_error
 } monitor_state;
 
@@ -77,10 +101,22 @@ static struct
     unsigned int address;
     unsigned int arg;
     unsigned char digits;
+#if PROFILE
+    unsigned long passes;
+    unsigned int started;
+#endif
 } __pdata m;
 
 
-static unsigned char dump_address( unsigned int address, unsigned char area )
+//! maximum number of data bytes in a frame of the block dump
+/*! a frame has to fit into the UART TX buffer */
+#define DUMP_FRAME_MAX (32)
+#define STX (0x02)
+
+//! area selected by the number of digits given with 'm' or 'M'
+#define AREA() ((m.digits == 5) ? 2 : (m.digits > 2))
+
+static unsigned char read_address( unsigned int address, unsigned char area )
 {
     unsigned char c = 0xff;
 
@@ -96,13 +132,67 @@ static unsigned char dump_address( unsigned int address, unsigned char area )
             c = *(unsigned char __xdata *)address;
             break;
         case 2: /* code (anywhere in the SPI flash) */
-            c = flash_read_byte(m.address_page, m.address);
+            c = flash_read_byte(m.address_page, address);
             break;
     }
+    return c;
+}
+
+static unsigned char dump_address( unsigned int address, unsigned char area )
+{
+    unsigned char c = read_address( address, area );
+
     puthex( c );
     return c;
 }
 
+//! send the next frame of a block dump (if the UART can take it)
+/*! Frame: STX, len, address hi, address lo, len data bytes, checksum.
+    The checksum makes the sum of all bytes after STX zero.
+    A frame with len 0 ends the dump. m.arg holds the number of
+    bytes still to send, m.address advances with the dump.
+    \return not zero if the dump is complete
+ */
+static bool dump_block_step( void )
+{
+    static unsigned char __xdata frame[DUMP_FRAME_MAX];
+    unsigned char len;
+    unsigned char i;
+    unsigned char sum;
+    unsigned char c;
+
+    len = (m.arg > DUMP_FRAME_MAX) ? DUMP_FRAME_MAX : (unsigned char)m.arg;
+
+    if( tx_space() < len + 5 )
+        return 0;
+
+    if( AREA() == 2 )
+        flash_read_block( (unsigned char)m.address_page, m.address, frame, len );
+    else
+        for( i = 0; i < len; i++ )
+            frame[i] = read_address( m.address + i, AREA() );
+
+    putchar( STX );
+    putchar( len );
+    putchar( (unsigned char)(m.address >> 8) );
+    putchar( (unsigned char)m.address );
+    sum = len + (unsigned char)(m.address >> 8) + (unsigned char)m.address;
+
+    m.arg -= len;
+    for( i = 0; i < len; i++ )
+    {
+        c = frame[i];
+        putchar( c );
+        sum += c;
+        if( !++m.address && AREA() == 2 )
+            m.address_page++;
+    }
+
+    putchar( (unsigned char)-sum );
+
+    return !len;
+}
+
 
 static unsigned char get_next_digit( unsigned int __pdata *value, unsigned char c )
 {
@@ -177,10 +267,71 @@ void prompt()
 }
 
 
-void monitor()
+void monitor() __banked
 {
     unsigned char c;
 
+    /* block dump, a frame at a time */
+    if( m.state == command_dump )
+    {
+        if( dump_block_step() )
+        {
+            m.state = monitor_idle;
+            prompt();
+        }
+        return;
+    }
+
+    /* flash checksum runs in the main loop, wait for the result */
+    if( m.state == command_verify )
+    {
+        if( flash_checksum.status != FLASH_CHECKSUM_RUNNING )
+        {
+            if( flash_checksum.status == FLASH_CHECKSUM_OK )
+                SLOG3( "\r\npage %02x sum %04x%04x ok", flash_checksum.page,
+                       (unsigned int)(flash_checksum.sum >> 16), (unsigned int)flash_checksum.sum );
+            else
+                SLOG3( "\r\npage %02x sum %04x%04x BAD", flash_checksum.page,
+                       (unsigned int)(flash_checksum.sum >> 16), (unsigned int)flash_checksum.sum );
+            m.state = monitor_idle;
+            prompt();
+        }
+        return;
+    }
+
+#if PROFILE
+    /* main loop passes without sleeping, see tools/hotcold.py --passes */
+    if( m.state == command_passes )
+    {
+        if( (unsigned int)(get_tick() - m.started) >= PROFILE_PASSES_TICKS )
+        {
+            unsigned long n = profile_passes - m.passes;
+
+            may_sleep = 1;
+            putcrlf();
+            putchar( 'l' );
+            puthex_u16( PROFILE_PASSES_TICKS );
+            putspace();
+            puthex_u16( (unsigned int)(n >> 16) );
+            puthex_u16( (unsigned int)n );
+            m.state = monitor_idle;
+            prompt();
+        }
+        return;
+    }
+#endif
+
+    /* long running check, a step at a time */
+    if( m.state == command_check )
+    {
+        if( ds2756_check_conversions( 0 ) )
+        {
+            m.state = monitor_idle;
+            prompt();
+        }
+        return;
+    }
+
     if( !char_avail() )
         return;
 
@@ -222,7 +373,7 @@ void monitor()
                     break;
 
                 case '?': /* list of commands */
-                    putstring( "\r\n?bBcdgGmMrsSw+-=&| see \"" __FILE__ "\"");
+                    SLOG0( "\r\n?bBcdgGKmMpPrsSTvVwX+-=&| see \"monitor.c\"" );
                     prompt();
                     break;
 
@@ -237,17 +388,11 @@ void monitor()
                     break;
 
                 case 'c': /* temperature of internal sensor */
-#if DEBUG && defined(SDCC)
-                    PRINTF( "\r\n%d degC", adc_to_degC( adc_cache[0] ) );
-#else
-
-                    putstring( "\r\n0x" );
-                    puthex( adc_to_degC( adc_cache[0] ) );
-                    putstring( " degC" );
-#endif
+                    SLOG2( "\r\n%d degC, %d centi-degC", adc_to_degC( adc_cache[0] ),
+                                                        adc_to_centi_degC( adc_get( 0 ) ) );
                     prompt();
                     break;
-#if DEBUG && defined(SDCC)
+#if DEBUG
 
                 /* temporarily here: */
                 case 'C': /* dump temperature conversion */
@@ -261,7 +406,8 @@ void monitor()
                                 puthex(i);
                                 putchar(':');
                             }
-                            PRINTF(" %d", adc_to_degC(i));
+                            putspace();
+                            put_s8(adc_to_degC(i));
                         } while(++i);
                       }
                     break;
@@ -282,6 +428,11 @@ void monitor()
                     prompt();
                     break;
 
+                case 'K': /* check and benchmark the DS2756 conversion kernels */
+                    ds2756_check_conversions( 1 );
+                    m.state = command_check;
+                    break;
+
                 case 'm': /* set address */
                     get_next_digit( &m.address, 0x00 );
                     m.state = command_m;
@@ -294,6 +445,46 @@ void monitor()
                     m.state = command_M;
                     break;
 
+                case 'p': /* program counter histogram (needs PROFILE in timer.h) */
+#if PROFILE
+                    {
+                        unsigned char i;
+                        unsigned int n;
+
+                        /* "p<address> <hits>" per bucket, read by tools/hotcold.py */
+                        for( i = 0; i < PROFILE_BUCKETS; i++ )
+                        {
+                            P1IE &= ~0x80;
+                            n = profile_hits[i];
+                            profile_hits[i] = 0;
+                            P1IE |= 0x80;
+
+                            if( n )
+                            {
+                                putcrlf();
+                                putchar( 'p' );
+                                puthex_u16( (unsigned int)i * (0x10000uL / PROFILE_BUCKETS) );
+                                putspace();
+                                puthex_u16( n );
+                            }
+                        }
+                    }
+#endif
+                    prompt();
+                    break;
+
+                case 'P': /* main loop passes in PROFILE_PASSES_TICKS (needs PROFILE) */
+#if PROFILE
+                    may_sleep = 0;
+                    m.passes = profile_passes;
+                    m.started = get_tick();
+                    m.state = command_passes;
+                    break;
+#else
+                    prompt();
+                    break;
+#endif
+
                 case 'r': /* rebooting */
                     reboot();
                     break;
@@ -311,12 +502,32 @@ void monitor()
                     prompt();
                     break;
 
+                case 'T': /* post-mortem trace */
+                    trace_dump();
+                    prompt();
+                    break;
+
+                case 'v': /* verify checksum of the running image */
+                    flash_checksum_start( flash_running_page() );
+                    m.state = command_verify;
+                    break;
+
+                case 'V': /* verify checksum of the 64k page set by 'M' */
+                    flash_checksum_start( (unsigned char)m.address_page );
+                    m.state = command_verify;
+                    break;
+
                 case 'w': /* watchdog reboot */
-                    putstring("\r\nWatchdog bites?");
+                    SLOG0("\r\nWatchdog bites?");
                     while (1)
                         ;
                     break;
 
+                case 'X': /* binary block dump of n bytes (hex) from address set by 'm' or 'M' */
+                    get_next_digit( &m.arg, 0x00 );
+                    m.state = command_X;
+                    break;
+
                 case '=': /* set address to value (can access either data, SFR, xdata, or xdata SFR) */
                     get_next_digit( &m.arg, 0x00 );
                     m.state = command_set;
@@ -356,6 +567,24 @@ void monitor()
             }
             break;
 
+        case command_X: /* get length of block dump (up to 4 digits) */
+            {
+                unsigned char digits;
+
+                digits = get_next_digit( &m.arg, c);
+                if( digits > 4 )
+                    m.state = command_error;
+                else
+                {
+                    if( digits )
+                    {
+                        putcrlf();
+                        m.state = command_dump;
+                    }
+                }
+            }
+            break;
+
         // just a hack. Likely will be removed.
         case command_M: /* get single digit for 64k page */
             {
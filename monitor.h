@@ -22,4 +22,4 @@
    what you give them.   Help stamp out software-hoarding!
 -------------------------------------------------------------------------*/
 
-void monitor();
+void monitor() __banked;   /* see bank.c */
@@ -39,10 +39,15 @@
 #include <stdbool.h>
 #include "chip.h"
 #include "battery.h"
+#include "flash.h"
+#include "flash_prog.h"
+#include "idle.h"
+#include "manufacturing.h"
 #include "matrix_3x3.h"
 #include "port_0x6c.h"
 #include "states.h"
 #include "timer.h"
+#include "trace.h"
 
 #define IBF 0x02
 #define OBF 0x01
@@ -63,6 +68,12 @@ static unsigned char __xdata six_zero_bytes[6];
 
 static unsigned char __pdata command;
 
+static unsigned char __xdata trace_request;
+
+static unsigned char __xdata keycode_reply[5];
+
+volatile unsigned char __pdata host_deferred_command;
+
 
 #if defined(SDCC)
 # pragma disable_warning 126
@@ -146,6 +157,7 @@ void host_interface_interrupt(void) __interrupt(0x0e)
            to "new command" state.
          */
         transfer_countdown = 0;
+        host_deferred_command = 0;
 
          /* E3: If OBF=1, EC clears it by writing 0x01 to reg 0xfe9e.  This is the
             crucial interlock that makes the protocol predictable - this must
@@ -164,6 +176,7 @@ void host_interface_interrupt(void) __interrupt(0x0e)
 
         /* write new input to the debugging area (if enabled) */
         STATES_UPDATE(command, command);
+        TRACE_IRQ(TRACE_HOST_COMMAND, command);
 
         switch( command )
         {
@@ -318,6 +331,99 @@ void host_interface_interrupt(void) __interrupt(0x0e)
                     TRANSFER_TO_HOST_INIT(&power_rail_status, 1);
                 }
                 break;
+            case 0x40:
+                /* Read battery history (openec specific, 1 + n bytes)
+                   o first byte is the number of bytes following
+                   o repeat until 0 is returned
+                   Answered from the main loop (history_drain_to_host())
+                 */
+                host_deferred_command = command;
+                busy = 1;
+                break;
+            case 0x41:
+                /* Read trace buffer (openec specific)
+                   o Cmd data n = 0..3 returns trace entries 16n..16n+15 (64 bytes),
+                     n = 4 returns the 8 byte trace header
+                   o reading n = 3 releases the entries kept over a reset
+                 */
+                TRANSFER_FROM_HOST_INIT(&trace_request, 1);
+                break;
+            case 0x42:
+                /* Read flash checksum status (openec specific, 6 bytes)
+                   o status: 0 not run, 1 running, 2 ok, 3 bad
+                   o 64k page of the SPI flash
+                   o 32 bit sum (little endian), zero for a good image
+                 */
+                TRANSFER_TO_HOST_INIT((unsigned char __xdata *)&flash_checksum, sizeof flash_checksum);
+                break;
+            case 0x43:
+                /* Read manufacturing data tag index (openec specific, 1 + 5n bytes)
+                   o number n of tags
+                   o per tag: name (2 bytes), length, data address (2 bytes, little endian)
+                     within page 0x0e of the SPI flash
+                 */
+                TRANSFER_TO_HOST_INIT((unsigned char __xdata *)&manufacturing_index, manufacturing_index_size);
+                break;
+            case 0x44:
+                /* Start programming the SPI flash (openec specific, \see flash_prog.c)
+                   o Cmd data: 64k page, address hi, address lo (multiple of 64)
+                 */
+                TRANSFER_FROM_HOST_INIT(&flash_prog_request, 3);
+                break;
+            case 0x45: /* Erase the 64k sector of the page given with 0x44 */
+                flash_prog_pending |= FLASH_PROG_PENDING_ERASE;
+                busy = 1;
+                TRANSFER_END();
+                break;
+            case 0x46:
+                /* Program data (64 bytes) at the current address
+                   o check with 0x47 that an upload buffer is free
+                 */
+                if( !(flash_prog_full & (flash_prog_fill_next ? 0x02 : 0x01)) )
+                    TRANSFER_FROM_HOST_INIT(&flash_prog_buf[flash_prog_fill_next], FLASH_PROG_BUF);
+                else
+                    TRANSFER_FROM_HOST_INIT(&flash_prog_buf[2], FLASH_PROG_BUF);
+                break;
+            case 0x47: /* Read SPI flash programming status (6 bytes) */
+                flash_prog_status.full = flash_prog_full;
+                TRANSFER_TO_HOST_INIT((unsigned char __xdata *)&flash_prog_status, sizeof flash_prog_status);
+                break;
+            case 0x48:
+                /* Read keycode FIFO (openec specific, 5 bytes)
+                   o number of entries including this one, 0 if empty.
+                     Bit 7 is set if the FIFO ran full since the last read
+                   o make/break code (2 bytes, 0x00 in the second byte
+                     for single byte codes)
+                   o tick the key change was detected (2 bytes, little endian)
+                 */
+                {
+                    unsigned char t = cursors.tail;
+                    unsigned char n = (unsigned char)(cursors.head - t) & (KEYCODE_FIFO - 1);
+
+                    keycode_reply[0] = n;
+                    if( n )
+                    {
+                        keycode_reply[1] = cursors.keycode[t].code[0];
+                        keycode_reply[2] = cursors.keycode[t].code[1];
+                        keycode_reply[3] = (unsigned char)cursors.keycode[t].tick;
+                        keycode_reply[4] = (unsigned char)(cursors.keycode[t].tick >> 8);
+                        cursors.tail = (unsigned char)(t + 1) & (KEYCODE_FIFO - 1);
+                    }
+                    else
+                    {
+                        keycode_reply[1] = 0;
+                        keycode_reply[2] = 0;
+                        keycode_reply[3] = 0;
+                        keycode_reply[4] = 0;
+                    }
+                    if( cursors.overflow )
+                    {
+                        keycode_reply[0] |= 0x80;
+                        cursors.overflow = 0;
+                    }
+                    TRANSFER_TO_HOST_INIT(&keycode_reply, 5);
+                }
+                break;
         }
     }
     else /* new data received! */
@@ -387,17 +493,52 @@ void host_interface_interrupt(void) __interrupt(0x0e)
                     break;
                 case 0x26: /* DCON power enable/disable */
                     break;
+                case 0x44:
+                    flash_prog_pending |= FLASH_PROG_PENDING_START;
+                    busy = 1;
+                    break;
+                case 0x46:
+                    if( transfer_ptr == &flash_prog_buf[2][FLASH_PROG_BUF] )
+                    {
+                        /* no buffer was free */
+                        flash_prog_status.state = FLASH_PROG_FAILED;
+                        flash_prog_status.error = FLASH_PROG_ERR_OVERRUN;
+                    }
+                    else
+                    {
+                        flash_prog_full |= flash_prog_fill_next ? 0x02 : 0x01;
+                        flash_prog_fill_next ^= 1;
+                    }
+                    busy = 1;
+                    break;
+                case 0x41: /* Read trace buffer, zero copy */
+                    if( trace_request < 4 )
+                    {
+                        TRANSFER_TO_HOST_INIT((unsigned char __xdata *)&trace_ring[trace_request * 16], 64);
+                        if( trace_request == 3 )
+                            trace_header.stop = TRACE_NO_STOP;
+                    }
+                    else
+                        TRANSFER_TO_HOST_INIT((unsigned char __xdata *)&trace_header, sizeof trace_header);
+                    break;
             }
         }
+
+        /* E8: clear IBF */
+        LPC68CSR = 0x02;
     }
 }
 
 
 //! routine for nonIRQ code to respond with data to a request from within IRQ
-void respond_to_host(unsigned char my_command,
+/*! \return - zero if the host has moved on and nothing was sent
+ */
+bool respond_to_host(unsigned char my_command,
                      unsigned char __xdata * my_transfer_ptr,
                      unsigned char my_len)
 {
+    bool sent = 0;
+
     HOST_INTERFACE_INTERRUPT_DISABLE;
 
     /* only if host has not issued a new command */
@@ -409,6 +550,7 @@ void respond_to_host(unsigned char my_command,
            (Should host explicitly send a break command
            before issuing a new one?) */
         TRANSFER_TO_HOST_INIT( my_transfer_ptr, my_len);
+        sent = 1;
     }
     else
     {
@@ -418,6 +560,8 @@ void respond_to_host(unsigned char my_command,
     }
 
     HOST_INTERFACE_INTERRUPT_ENABLE;
+
+    return sent;
 }
 
 
@@ -25,11 +25,14 @@
 #define HOST_INTERFACE_INTERRUPT_ENABLE  do{ P0IE |=  0x20; } while(0)
 #define HOST_INTERFACE_INTERRUPT_DISABLE do{ P0IE &= ~0x20; } while(0)
 
+//! command that is to be answered from within the main loop (0 if none)
+extern volatile unsigned char __pdata host_deferred_command;
+
 void host_interface_init(void);
 
 void host_interface_interrupt(void) __interrupt(0x0e);
 
-void respond_to_host(unsigned char my_command,
+bool respond_to_host(unsigned char my_command,
                      unsigned char __xdata * my_transfer_ptr,
                      unsigned char len);
 
@@ -44,12 +44,12 @@
 #include "chip.h"
 #include "states.h"
 #include "timer.h"
+#include "trace.h"
 #include "one_wire.h"
 #include "power.h"
 
 /* dangerous! */
 #define ENABLE_OUTPUTS (0)
-#define SIMPLE (1)
 
 #define IS_MAIN_ON    (GPIOD18 & 0x04) /* (B1 about 68mm, 108mm)U13,6  CS5536 WORKING? Bidirectional! */
 #define IS_SUS_ON     (GPIOD18 & 0x08) /* (B1 near SD-Card)U33,6  CS5536 WORK_AUX? */
@@ -86,48 +86,223 @@
 #define POWER_BUTTON_PRESSED !(GPIOEIN0 & 0x80)             /* R74 next to SD-Card */
 
 
-typedef enum
+/* outputs, a step switches them on or off when it is entered */
+#define POWER_VR_ON       (0x01)   /**< SWITCH_VR_ONn_ON() */
+#define POWER_WLAN        (0x02)   /**< SWITCH_WLAN_ON() */
+#define POWER_DCON_EN     (0x04)   /**< SWITCH_DCON_EN_ON() */
+#define POWER_PWR_BUT     (0x08)   /**< SWITCH_PWR_BUTn_ON(), PWR_BUT# low */
+#define POWER_SWI         (0x10)   /**< SWITCH_SWIn_ON(), SWI# low */
+#define POWER_MAIN_ON_PU  (0x20)   /**< SWITCH_MAIN_ON_PU_ON() */
+#define POWER_ECPWRRQST   (0x40)   /**< SWITCH_ECPWRRQST_ON() */
+#define POWER_LED         (0x80)   /**< LED_PWR_ON() */
+#define POWER_ALL         (0xff)
+
+/* conditions a step waits for */
+#define POWER_NEVER       (0)      /**< only the timeout ends the step */
+#define POWER_IF_OW_IDLE  (1)      /**< !ow_busy() */
+#define POWER_IF_MAIN_ON  (2)      /**< IS_MAIN_ON */
+#define POWER_IF_MAIN_OFF (3)
+#define POWER_IF_SUS_ON   (4)      /**< IS_SUS_ON */
+#define POWER_IF_SUS_OFF  (5)
+#define POWER_IF_ALL_OFF  (6)      /**< IS_MAIN_OFF_AND_SUS_OFF */
+#define POWER_IF_BUTTON   (7)      /**< POWER_BUTTON_PRESSED */
+#define POWER_IF_NO_BUTTON (8)
+#define POWER_IF_WAKEUP   (9)      /**< wakeup_second reached */
+#define POWER_IF_WAKE     (10)     /**< button or wakeup_second */
+
+//! no timeout for this step
+#define POWER_FOREVER     (0)
+
+/* steps, index into power_step[] */
+#define P_OFF             (0)
+#define P_ON_PRESS        (1)
+#define P_ON_WLAN         (2)
+#define P_ON_RAILS        (3)
+#define P_ON_PWR_BUT      (4)
+#define P_ON_RELEASE      (5)
+#define P_RUNNING         (6)
+#define P_HOST_DOWN       (7)
+#define P_SUSPENDED       (8)
+#define P_RESUME          (9)
+#define P_OFF_REQUEST     (10)
+#define P_OFF_RAILS       (11)
+
+//! one step of the power sequence
+/*! The outputs are switched when the step is entered. The step ends
+    as soon as "wait" (or "alt_wait") is met, so a rail that is up
+    early is not held back by a worst case delay. "timeout" (in
+    ticks) is the fallback if the feedback does not come.
+ */
+typedef struct
+{
+    unsigned char on;            /**< POWER_* outputs switched on */
+    unsigned char off;           /**< POWER_* outputs switched off (before "on") */
+    unsigned char wait;          /**< POWER_IF_* condition */
+    unsigned char next;
+    unsigned char alt_wait;      /**< second POWER_IF_* condition or POWER_NEVER */
+    unsigned char alt_next;
+    unsigned char timeout;       /**< ticks or POWER_FOREVER */
+    unsigned char timeout_next;
+} power_step_type;
+
+static const power_step_type __code power_step[] =
 {
-    XO_OFF,
-    WAIT_FOR_POWER_BUTTON_RELEASE,
-    XO_POWER_BUTTON_TOO_LONG_FOR_POWER_ON,
-    XO_SWITCH_ON_FROM_WAKEUP,
-    XO_SWITCH_ON_1,
-
-    XO_SWITCH_ON_2,
-    XO_SWITCH_ON_3,
-    XO_SWITCH_ON_4,
-    XO_SWITCH_ON_5,
-    XO_RUNNING,
-
-    XO_IS_IT_SUSPEND,
-    XO_SWITCH_OFF_FROM_RUNNING,
-    XO_SUSPEND,
-    XO_SWITCH_TO_SUSPEND,
-    SUSPEND_WAIT_FOR_POWER_BUTTON_RELEASE,
-
-    XO_SWITCH_OFF_FROM_SUSPEND,
-    XO_SWITCH_OFF_SHORT_BLINK,
-    XO_SWITCH_OFF_1,
-    XO_SWITCH_OFF_2,
-    XO_MAIN_OR_SUS_ERROR,
-
-    XO_EMERGENCY_OFF
-} state;
+    /* P_OFF: everything off, SWI# low. LED_PWR is left to port_init() */
+    { POWER_SWI, POWER_ALL & ~(POWER_SWI | POWER_LED),
+      POWER_IF_BUTTON,    P_ON_PRESS,
+      POWER_IF_WAKEUP,    P_ON_WLAN,
+      POWER_FOREVER,      P_OFF },
+
+    /* P_ON_PRESS: the button has to be held for HZ/10 */
+    { 0, 0,
+      POWER_IF_NO_BUTTON, P_OFF,
+      POWER_NEVER,        P_OFF,
+      HZ/10,              P_ON_WLAN },
+
+    /* P_ON_WLAN: the Geode and the EC share the LPC flash. The Geode
+       fetching would most likely spoil the timing of the 1-wire bus */
+    { POWER_LED | POWER_WLAN, 0,
+      POWER_IF_OW_IDLE,   P_ON_RAILS,
+      POWER_NEVER,        P_OFF,
+      POWER_FOREVER,      P_OFF },
+
+    /* P_ON_RAILS: fixed HZ/4. There is no power good input, MAIN_ON
+       would be met by our own pull up and SUS_ON comes only after
+       PWR_BUT# */
+    { POWER_VR_ON | POWER_MAIN_ON_PU | POWER_DCON_EN, POWER_PWR_BUT | POWER_SWI,
+      POWER_NEVER,        P_OFF,
+      POWER_NEVER,        P_OFF,
+      HZ/4,               P_ON_PWR_BUT },
+
+    /* P_ON_PWR_BUT: the southbridge answers with SUS_ON */
+    { POWER_PWR_BUT, 0,
+      POWER_IF_SUS_ON,    P_ON_RELEASE,
+      POWER_NEVER,        P_OFF,
+      HZ,                 P_ON_RELEASE },
+
+    /* P_ON_RELEASE: running, but the button press that switched us
+       on (or resumed us) must not switch us off again */
+    { POWER_LED | POWER_PWR_BUT, 0,
+      POWER_IF_NO_BUTTON, P_RUNNING,
+      POWER_IF_MAIN_OFF,  P_HOST_DOWN,
+      POWER_FOREVER,      P_OFF },
+
+    /* P_RUNNING */
+    { 0, 0,
+      POWER_IF_BUTTON,    P_OFF_REQUEST,
+      POWER_IF_MAIN_OFF,  P_HOST_DOWN,
+      POWER_FOREVER,      P_OFF },
+
+    /* P_HOST_DOWN: the host dropped MAIN_ON. With SUS_ON following
+       it switched off, with SUS_ON staying it suspended */
+    { 0, 0,
+      POWER_IF_SUS_OFF,   P_OFF_RAILS,
+      POWER_IF_MAIN_ON,   P_RUNNING,
+      HZ/10,              P_SUSPENDED },
+
+    /* P_SUSPENDED: DCON and WLAN stay powered */
+    { 0, POWER_PWR_BUT,
+      POWER_IF_WAKE,      P_RESUME,
+      POWER_IF_MAIN_ON,   P_ON_RELEASE,
+      POWER_FOREVER,      P_OFF },
+
+    /* P_RESUME: a PWR_BUT# edge wakes the southbridge */
+    { POWER_PWR_BUT, 0,
+      POWER_IF_MAIN_ON,   P_ON_RELEASE,
+      POWER_NEVER,        P_OFF,
+      HZ,                 P_OFF_REQUEST },
+
+    /* P_OFF_REQUEST: powerdown procedure, maybe see
+       http://dev.laptop.org/ticket/218. Was a fixed HZ/10 */
+    { POWER_PWR_BUT, POWER_MAIN_ON_PU,
+      POWER_IF_ALL_OFF,   P_OFF_RAILS,
+      POWER_NEVER,        P_OFF,
+      HZ/10,              P_OFF_RAILS },
+
+    /* P_OFF_RAILS: P_OFF is entered once the button is released */
+    { POWER_SWI, POWER_VR_ON | POWER_DCON_EN | POWER_WLAN | POWER_LED,
+      POWER_IF_NO_BUTTON, P_OFF,
+      POWER_NEVER,        P_OFF,
+      POWER_FOREVER,      P_OFF },
+};
 
 
 static struct
 {
-    unsigned char my_tick;
-    unsigned char timer;
-    state state;
+    unsigned char state;
+    unsigned char entered;       /**< tick the step was entered */
     unsigned long wakeup_second;
 } __pdata power_private;
 
 bool XO_suspended;
 
 
-#if SIMPLE
+//! switch the outputs of a step
+static void power_switch(unsigned char on, unsigned char off)
+{
+    if( off & POWER_VR_ON )      SWITCH_VR_ONn_OFF();
+    if( off & POWER_WLAN )       SWITCH_WLAN_OFF();
+    if( off & POWER_DCON_EN )    SWITCH_DCON_EN_OFF();
+    if( off & POWER_PWR_BUT )    SWITCH_PWR_BUTn_OFF();
+    if( off & POWER_SWI )        SWITCH_SWIn_OFF();
+    if( off & POWER_MAIN_ON_PU ) SWITCH_MAIN_ON_PU_OFF();
+    if( off & POWER_ECPWRRQST )  SWITCH_ECPWRRQST_OFF();
+    if( off & POWER_LED )        LED_PWR_OFF();
+
+    if( on & POWER_VR_ON )       SWITCH_VR_ONn_ON();
+    if( on & POWER_WLAN )        SWITCH_WLAN_ON();
+    if( on & POWER_DCON_EN )     SWITCH_DCON_EN_ON();
+    if( on & POWER_PWR_BUT )     SWITCH_PWR_BUTn_ON();
+    if( on & POWER_SWI )         SWITCH_SWIn_ON();
+    if( on & POWER_MAIN_ON_PU )  SWITCH_MAIN_ON_PU_ON();
+    if( on & POWER_ECPWRRQST )   SWITCH_ECPWRRQST_ON();
+    if( on & POWER_LED )         LED_PWR_ON();
+}
+
+
+//! evaluate a POWER_IF_* condition
+static bool power_condition(unsigned char c)
+{
+    switch( c )
+    {
+        case POWER_IF_OW_IDLE:   return !ow_busy();
+        case POWER_IF_MAIN_ON:   return IS_MAIN_ON;
+        case POWER_IF_MAIN_OFF:  return !IS_MAIN_ON;
+        case POWER_IF_SUS_ON:    return IS_SUS_ON;
+        case POWER_IF_SUS_OFF:   return !IS_SUS_ON;
+        case POWER_IF_ALL_OFF:   return IS_MAIN_OFF_AND_SUS_OFF;
+        case POWER_IF_BUTTON:    return POWER_BUTTON_PRESSED;
+        case POWER_IF_NO_BUTTON: return !POWER_BUTTON_PRESSED;
+        case POWER_IF_WAKE:
+            if( POWER_BUTTON_PRESSED )
+                return 1;
+            /* fall through */
+        case POWER_IF_WAKEUP:
+            /*! use a GPT for this? */
+            if( power_private.wakeup_second == get_time() )
+            {
+                power_private.wakeup_second ^= 0x80000000uL; /**< kludge to make it happen only once */
+                return 1;
+            }
+            return 0;
+    }
+    return 0;
+}
+
+
+//! enter a step and switch its outputs
+static void power_enter(unsigned char s)
+{
+    power_private.state = s;
+    power_private.entered = (unsigned char)tick;
+    power_switch(power_step[s].on, power_step[s].off);
+
+    XO_suspended = (s == P_SUSPENDED);
+
+    STATES_UPDATE(power, s);
+    trace_state(TRACE_POWER, s);
+}
+
 
 void power_init(void)
 {
@@ -142,13 +317,7 @@ void power_init(void)
 
 
     /*! all outputs to off before enabling them as output */
-    SWITCH_VR_ONn_OFF();
-    SWITCH_DCON_EN_OFF();
-    SWITCH_ECPWRRQST_OFF();
-    SWITCH_WLAN_OFF();
-    SWITCH_SWIn_ON();
-    SWITCH_PWR_BUTn_OFF();
-    SWITCH_MAIN_ON_PU_OFF(); /* pullup off */
+    power_enter(P_OFF);
 
     /*! WLAN_EN is output. This one is here because the pin is floating on a B1. (remove) */
     GPIOOE00 |= 0x02;
@@ -174,8 +343,8 @@ void power_init(void)
 
 
 //! Switches On/Off power to the various subsystems
-/*! This one is just a HACK to try to get things going.
-
+/*! Runs the steps in power_step[]. Called every main loop pass
+    so a step ends as soon as its condition is met.
 
     \verbatim
     approximate power on timing as measured on B1 Q2C23
@@ -201,405 +370,16 @@ void power_init(void)
     \endverbatim
 
     (WLAN Power on seems very early)
-
  */
 void handle_power(void)
 {
-    /* do not want to be called twice per tick */
-    if( power_private.my_tick == (unsigned char)tick )
-        return;
-    power_private.my_tick = (unsigned char)tick;
-
-    switch( power_private.state )
-    {
-        case 0:
-            if( POWER_BUTTON_PRESSED )
-            {
-                power_private.timer++;
-                if( power_private.timer == HZ/10 )
-                {
-                    LED_PWR_ON();
-                    power_private.state = 1;
-                }
-            }
-            else
-                power_private.timer = 0;
-            break;
-
-        case 1:
-            SWITCH_WLAN_ON();
-            power_private.state = 2;
-            break;
-
-        case 2:
-            /* only proceed if the 1-wire bus is not active.
-               (the Geode and the EC are using the same LPC flash.
-               The Geode fetching would most likely spoil timing
-               of the 1-wire bus)
-             */
-            if( !ow_busy() )
-            {
-                SWITCH_PWR_BUTn_OFF();
-                SWITCH_VR_ONn_ON();
-                SWITCH_SWIn_OFF();
-                SWITCH_MAIN_ON_PU_ON();
-                SWITCH_DCON_EN_ON();
-
-                power_private.timer = 0;
-                power_private.state = 3;
-            }
-            break;
-
-        case 3:
-            /* just a timer... should probably check also some "ready" bit? */
-            if( ++power_private.timer == HZ/4 )
-            {
-                SWITCH_PWR_BUTn_ON();
-
-                // maybe:  SWITCH_MAIN_ON_PU_OFF;
-
-                power_private.timer = 0;
-                power_private.state = 4;
-            }
-            break;
-
-        case 4:
-            if( POWER_BUTTON_PRESSED )
-            {
-                /* powerdown procedure, maybe see http://dev.laptop.org/ticket/218 */
-                SWITCH_PWR_BUTn_ON();
-                SWITCH_MAIN_ON_PU_OFF();
-                power_private.timer = 0;
-                power_private.state = 5;
-            }
-            break;
-
-        case 5:
-            if(  /* wait for Southbridge to turn these off */
-                 IS_MAIN_OFF_AND_SUS_OFF ||
-                 /* but do not wait forever */
-                 (++power_private.timer == HZ/10)  )
-            {
-                SWITCH_VR_ONn_OFF();
-                SWITCH_SWIn_ON();
-                SWITCH_DCON_EN_OFF();
-                SWITCH_WLAN_OFF();
-                LED_PWR_OFF();
-                power_private.state = 6;
-            }
-            break;
-
-        case 6:
-            if( !POWER_BUTTON_PRESSED )
-            {
-                power_private.timer = 0;
-                power_private.state = 0;
-            }
-            break;
-    }
-
-    STATES_UPDATE(power, power_private.state);
+    const power_step_type __code *p = &power_step[power_private.state];
+
+    if( power_condition(p->wait) )
+        power_enter(p->next);
+    else if( power_condition(p->alt_wait) )
+        power_enter(p->alt_next);
+    else if( p->timeout != POWER_FOREVER &&
+             (unsigned char)((unsigned char)tick - power_private.entered) >= p->timeout )
+        power_enter(p->timeout_next);
 }
-
-
-#else
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-//! this was the first try with some more states
-/*! but as it did not do the expected, I tried the
-    simpler version above.
- */
-void power_init(void)
-{
-    /*! POWER_BUTTON# is input */
-    GPIOEIN0_0xfc64 |= 0x80;  /* avoiding name clash, GPIOEIN0 */
-
-    /*! ACIN is input */
-//    GPIADIE0 |= 0x04;
-
-    /*! MAIN_ON, SUS_ON are input */
-    GPIOIE18 |= 0x0c;
-
-
-    /*! all outputs to off before enabling them as output */
-    SWITCH_VR_ONn_OFF();
-    SWITCH_DCON_EN_OFF();
-    SWITCH_ECPWRRQST_OFF();
-    SWITCH_WLAN_OFF();
-    SWITCH_SWIn_OFF();
-    SWITCH_PWR_BUTn_OFF();
-
-#if ENABLE_OUTPUTS
-# warning ENABLE_OUTPUTS might be dangerous!
-
-    /*! ECPWRRQST, DCON_EN are output */
-    GPIOEOE8 |= 0xa0;
-
-    /*! VR_ON#, WLAN_EN are output */
-    GPIOOE00 |= 0x03;
-
-    /*! PWR_BUT# is output */
-    GPIOOE08 |= 0x10;
-
-#endif
-
-    /*! notime soon:) */
-    power_private.wakeup_second = 0xFFFFffff;
-    //power_private.wakeup_second = 10;
-}
-
-
-//! Switches On/Off power to the various subsystems
-/*! potential inputs:
-        POWER_BUTTON, host request (shutdown, suspend, wlan, dcon),
-        powersupply, temperature, keyboard, keypad...
-    outputs:
-        ECPWRRQST
-        DCON
-        WLAN
-        others
- */
-void handle_power(void)
-{
-    /* do not want to be called twice per tick */
-    if( power_private.my_tick == (unsigned char)tick )
-        return;
-    power_private.my_tick = (unsigned char)tick;
-
-    switch(power_private.state)
-    {
-        case XO_OFF:
-            if( POWER_BUTTON_PRESSED )
-            {
-                power_private.timer++;
-                if( power_private.timer == (unsigned char)(HZ/10) )
-                {
-                    LED_PWR_ON();
-                    power_private.state = WAIT_FOR_POWER_BUTTON_RELEASE;
-                }
-            }
-            else
-                power_private.timer = 0;
-
-            /*! use a GPT for this? */
-            if( power_private.wakeup_second == get_time() )
-            {
-                power_private.state = XO_SWITCH_ON_FROM_WAKEUP;
-
-                power_private.wakeup_second ^= 0x80000000uL; /**< kludge to make it happen only once */
-            }
-
-            break;
-
-        case WAIT_FOR_POWER_BUTTON_RELEASE:
-            if( !POWER_BUTTON_PRESSED )
-            {
-                power_private.state = XO_SWITCH_ON_1 ;
-            }
-            else
-            {
-                if( ++power_private.timer == (unsigned char)HZ )
-                {
-                    LED_PWR_OFF();
-                    power_private.state = XO_POWER_BUTTON_TOO_LONG_FOR_POWER_ON;
-                }
-            }
-            break;
-
-        case XO_POWER_BUTTON_TOO_LONG_FOR_POWER_ON:
-            if( !POWER_BUTTON_PRESSED )
-            {
-                power_private.state = XO_OFF;
-            }
-            else
-            {
-                if( power_private.timer != 0xff )
-                    power_private.timer++;
-            }
-            break;
-
-        case XO_SWITCH_ON_FROM_WAKEUP:
-        case XO_SWITCH_ON_1:
-            LED_PWR_ON();
-            SWITCH_VR_ONn_ON();
-SWITCH_DCON_EN_ON();
-
-            power_private.timer = 0;
-            power_private.state = XO_SWITCH_ON_2;
-            break;
-
-        case XO_SWITCH_ON_2:
-            if( IS_MAIN_ON_AND_SUS_ON )
-            {
-                power_private.state = XO_SWITCH_ON_3;
-            }
-            else
-            {
-                if( ++power_private.timer == (unsigned char)HZ * 2 )
-                    power_private.state = XO_MAIN_OR_SUS_ERROR;
-            }
-            break;
-
-        case XO_SWITCH_ON_3:
-            SWITCH_DCON_EN_ON();
-            power_private.state = XO_SWITCH_ON_4;
-            break;
-
-        case XO_SWITCH_ON_4:
-            power_private.state = XO_SWITCH_ON_5;
-            break;
-
-        case XO_SWITCH_ON_5:
-            SWITCH_WLAN_ON();             /**< currently done here */
-            power_private.state = XO_RUNNING;
-            break;
-
-        case XO_RUNNING:
-            if( POWER_BUTTON_PRESSED )
-            {
-                power_private.state = XO_IS_IT_SUSPEND;
-                power_private.timer = 0;
-            }
-            else if ( 0 /* hosts requested power down */ /* hosts requested suspend */)
-            {
-                power_private.state = XO_SWITCH_OFF_2;
-            }
-            break;
-
-        case XO_IS_IT_SUSPEND:
-            if( !POWER_BUTTON_PRESSED )
-            {
-                SWITCH_PWR_BUTn_OFF();
-                power_private.state = XO_SWITCH_TO_SUSPEND;
-            }
-            else
-            {
-                if( ++power_private.timer == (unsigned char)HZ )
-                {
-                    /* tell host to power off */
-                    power_private.state = XO_SWITCH_OFF_FROM_RUNNING;
-                    power_private.timer = 0;
-                    /* also tell the host, how? */
-                    SWITCH_PWR_BUTn_ON(); /**< needs to be "pressed" for >=62 us (unfiltered) */
-                }
-            }
-            break;
-
-
-        case XO_SWITCH_OFF_FROM_RUNNING:
-
-            power_private.state = XO_SWITCH_OFF_SHORT_BLINK;
-            power_private.timer = 0;
-
-#if 0
-            /* southbrigde has turned power off? */
-            if( IS_MAIN_OFF_AND_SUS_OFF )
-            {
-                power_private.state = XO_SWITCH_OFF_SHORT_BLINK;
-                power_private.timer = 0;
-            }
-#endif
-            break;
-
-
-        case XO_SWITCH_TO_SUSPEND:
-            /* dummy */
-            power_private.state = XO_SUSPEND;
-            break;
-
-        case XO_SUSPEND:
-            if( power_private.wakeup_second == get_time() )
-                power_private.state = XO_SWITCH_ON_1;
-            else
-            {
-                if( POWER_BUTTON_PRESSED )
-                {
-                    power_private.state = SUSPEND_WAIT_FOR_POWER_BUTTON_RELEASE;
-                }
-                else 
-                {
-                    if( ((unsigned char)tick & 0x7e) == 0x00 )
-                        LED_PWR_ON();
-                    else
-                        LED_PWR_OFF();
-                }
-            }
-            break;
-
-
-        case SUSPEND_WAIT_FOR_POWER_BUTTON_RELEASE:
-            if( !POWER_BUTTON_PRESSED )
-            {
-                power_private.state = XO_SWITCH_ON_1 ;
-            }
-            else
-            {
-                if( ++power_private.timer == (unsigned char)HZ )
-                {
-                    LED_PWR_OFF();
-                    power_private.state = XO_SWITCH_OFF_FROM_SUSPEND;
-                    power_private.timer = 0;
-                }
-            }
-            break;
-
-        case XO_SWITCH_OFF_FROM_SUSPEND:
-        case XO_SWITCH_OFF_SHORT_BLINK:
-            if( power_private.timer >= 3 )
-                power_private.state = XO_SWITCH_OFF_1;
-            else
-            {
-                power_private.timer++;
-                LED_PWR_ON();
-            }
-            break;
-
-        case XO_SWITCH_OFF_1:
-            if( IS_MAIN_OFF_AND_SUS_OFF /* host acknowleged power down */ )
-            {
-                power_private.state = XO_SWITCH_OFF_2;
-            }
-            else
-            {
-                if( ++power_private.timer == (unsigned char)HZ )
-                {
-                    /* Hmmm, host should have reacted by now! Shutting down anyway */
-                    power_private.state = XO_EMERGENCY_OFF;
-                }
-            }
-            break;
-
-        case XO_SWITCH_OFF_2:
-        case XO_EMERGENCY_OFF:
-        case XO_MAIN_OR_SUS_ERROR:
-            SWITCH_DCON_EN_OFF();
-            SWITCH_WLAN_OFF(); /* ... */
-            SWITCH_VR_ONn_OFF();
-// SWITCH_PWR_BUT_OFF;
-// SWITCH_ECPWRRQST_OFF;
-// SWITCH_SWI_OFF;
-
-            LED_PWR_OFF();
-            power_private.state = XO_OFF;
-            break;
-    }
-
-    STATES_UPDATE(power, power_private.state);
-}
-#endif
@@ -0,0 +1,470 @@
+/*-------------------------------------------------------------------------
+   ps2.c - PS/2 keyboard and touchpad pass-through
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+/* The PS/2 block is run bit by bit: every falling clock edge on
+   a channel raises IRQ 0x0a and the ISR shifts one bit in or out.
+   Whole bytes (keyboard) or whole packets (touchpad) are queued,
+   so the main loop is woken once per packet and never per bit
+   or byte. handle_ps2() moves them into the KBC output queue
+   (keyboard bytes through kbc_put_keyboard(), which translates
+   them), releases the host inhibit and sends the bytes the host
+   writes for the keyboard and for the touchpad (0xd4).
+
+   The channel numbers and the pin and flag bits in PS2CFG,
+   PS2PF, PS2PINS and PS2PINO are unconfirmed.
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "idle.h"
+#include "kbc.h"
+#include "ps2.h"
+#include "states.h"
+#include "timer.h"
+
+#define PS2_CLK(ch)  (0x01 << (ch))  /**< PS2PF, PS2PINS, PS2PINO (unconfirmed) */
+#define PS2_DAT(ch)  (0x10 << (ch))  /**< PS2PINS, PS2PINO (unconfirmed) */
+
+/* a set PS2PINO bit pulls the open drain line low (unconfirmed) */
+#define PS2_CLK_LOW(ch)      do{ PS2PINO |=  PS2_CLK(ch); } while(0)
+#define PS2_CLK_RELEASE(ch)  do{ PS2PINO &= ~PS2_CLK(ch); } while(0)
+#define PS2_DAT_LOW(ch)      do{ PS2PINO |=  PS2_DAT(ch); } while(0)
+#define PS2_DAT_RELEASE(ch)  do{ PS2PINO &= ~PS2_DAT(ch); } while(0)
+
+//! ticks a frame may take before it is discarded (a frame takes about 1 ms)
+#define PS2_FRAME_TICKS  (2)
+//! ticks between the bytes of a packet before it is discarded
+#define PS2_PACKET_TICKS (5)
+//! ticks the clock is held low before sending (at least 100 us are needed)
+#define PS2_RTS_TICKS    (2)
+//! ticks a device may take to clock in a byte sent to it
+#define PS2_TX_TICKS     (3)
+
+#define PS2_IDLE      (0)
+#define PS2_RTS       (1)   /**< clock held low, about to send */
+#define PS2_TX        (2)   /**< device clocks the byte in */
+
+#define PS2_TX_ACK    (1)
+#define PS2_TX_NACK   (2)
+
+struct ps2_channel
+{
+    /* changed within IRQ */
+    unsigned char bitno;      /**< next bit of the frame, 0 is the start bit */
+    unsigned char shift;
+    unsigned char ones;       /**< parity of the bits so far */
+    unsigned char started;    /**< tick the frame started */
+    unsigned char tx_bitno;   /**< next bit to send, 0 if not sending */
+    volatile unsigned char tx_done;
+    bool inhibit;             /**< clock held low as the queue is full */
+    volatile bool resend;     /**< a byte was received with an error */
+    unsigned char errors;
+
+    /* touchpad packet assembly */
+    unsigned char fill;
+    unsigned char size;       /**< 3, or 4 for wheel mice */
+    unsigned char expect;     /**< command reply bytes still due, not packets */
+    unsigned char packet_started;
+    unsigned char packet[4];
+
+    struct ps2_packet queue[PS2_QUEUE];
+    unsigned char head;
+
+    /* main loop */
+    volatile unsigned char tail;
+    unsigned char state;
+    unsigned char tx;
+    bool host_tx;             /**< tx was written by the host (not a resend) */
+    unsigned char last_cmd;
+    unsigned char t;
+};
+
+static struct ps2_channel __xdata ps2[2];
+
+
+//! init hardware and set variables to default state
+void ps2_init(void)
+{
+    unsigned char ch;
+
+    PS2_INTERRUPT_DISABLE;
+
+    PS2CTRL = 0x00;                  /**< no hardware shifting (unconfirmed) */
+    PS2PINO = 0x00;                  /**< release all lines */
+    PS2CFG  = PS2_CLK(PS2_KEYBOARD) | PS2_CLK(PS2_TOUCHPAD); /**< falling edge IRQ (unconfirmed) */
+    PS2PF   = 0xff;
+
+    for( ch = 0; ch < 2; ch++ )
+    {
+        ps2[ch].bitno = 0;
+        ps2[ch].tx_bitno = 0;
+        ps2[ch].tx_done = 0;
+        ps2[ch].inhibit = 0;
+        ps2[ch].resend = 0;
+        ps2[ch].fill = 0;
+        ps2[ch].size = 3;
+        ps2[ch].expect = 0;
+        ps2[ch].head = ps2[ch].tail;
+        ps2[ch].state = PS2_IDLE;
+        ps2[ch].host_tx = 0;
+    }
+
+    PS2_INTERRUPT_ENABLE;
+}
+
+
+//! one bit per falling clock edge
+/*! Frames are start bit (0), 8 data bits LSB first,
+    odd parity and stop bit (1). When sending, the device
+    clocks and samples on the rising edge, the eleventh
+    edge is its acknowledge.
+    Don't call subroutines here.
+ */
+void ps2_interrupt(void) __interrupt(0x0a)
+{
+    unsigned char ch;
+    unsigned char pf;
+
+    /* reset IRQ pending flags */
+    pf = PS2PF;
+    PS2PF = pf;
+    P0IF &= ~0x04;
+
+    for( ch = 0; ch < 2; ch++ )
+    {
+        struct ps2_channel __xdata *c = &ps2[ch];
+        bool bit;
+
+        if( !(pf & PS2_CLK(ch)) )
+            continue;
+
+        bit = (PS2PINS & PS2_DAT(ch)) ? 1 : 0;
+
+        if( c->tx_bitno )
+        {
+            /* EC to device */
+            if( c->tx_bitno <= 8 )
+            {
+                if( c->tx & 0x01 )
+                {
+                    PS2_DAT_RELEASE(ch);
+                    c->ones ^= 1;
+                }
+                else
+                    PS2_DAT_LOW(ch);
+                c->tx >>= 1;
+            }
+            else if( c->tx_bitno == 9 )
+            {
+                if( c->ones )
+                    PS2_DAT_LOW(ch);
+                else
+                    PS2_DAT_RELEASE(ch);
+            }
+            else if( c->tx_bitno == 10 )
+            {
+                PS2_DAT_RELEASE(ch);   /**< stop bit */
+            }
+            else
+            {
+                c->tx_done = bit ? PS2_TX_NACK : PS2_TX_ACK;
+                c->tx_bitno = 0;
+                busy = 1;
+                continue;
+            }
+            c->tx_bitno++;
+            continue;
+        }
+
+        /* device to EC. A frame that stalled is discarded */
+        if( c->bitno && (unsigned char)((unsigned char)tick - c->started) > PS2_FRAME_TICKS )
+            c->bitno = 0;
+
+        if( c->bitno == 0 )
+        {
+            if( bit )
+                continue;              /**< no start bit */
+            c->started = (unsigned char)tick;
+            c->ones = 0;
+        }
+        else if( c->bitno <= 8 )
+        {
+            c->shift >>= 1;
+            if( bit )
+            {
+                c->shift |= 0x80;
+                c->ones ^= 1;
+            }
+        }
+        else if( c->bitno == 9 )
+        {
+            c->ones ^= bit;
+        }
+        else
+        {
+            unsigned char b = c->shift;
+
+            c->bitno = 0;
+
+            if( !bit || !c->ones )
+            {
+                /* framing or parity error, ask for the byte again */
+                c->errors++;
+                c->resend = 1;
+                busy = 1;
+                continue;
+            }
+
+            if( ch == PS2_TOUCHPAD && !c->expect )
+            {
+                /* stream mode. Drop stale partial packets and
+                   resynchronize on bit 3 of the first byte */
+                if( c->fill && (unsigned char)((unsigned char)tick - c->packet_started) > PS2_PACKET_TICKS )
+                    c->fill = 0;
+                if( !c->fill )
+                {
+                    if( !(b & 0x08) )
+                        continue;
+                    c->packet_started = (unsigned char)tick;
+                }
+                c->packet[c->fill++] = b;
+                if( c->fill < c->size )
+                    continue;
+            }
+            else
+            {
+                /* keyboard byte or command reply, passed on singly */
+                if( c->expect )
+                {
+                    c->expect--;
+                    /* device id (0xf2): 3 and 4 are wheel mice */
+                    if( !c->expect && c->last_cmd == 0xf2 )
+                        c->size = (b == 0x03 || b == 0x04) ? 4 : 3;
+                }
+                c->packet[0] = b;
+                c->fill = 1;
+            }
+
+            /* queue the packet */
+            {
+                unsigned char next_head = (unsigned char)(c->head + 1) & (PS2_QUEUE - 1);
+
+                if( next_head == c->tail )
+                    c->errors++;       /**< only if the inhibit came too late */
+                else
+                {
+                    struct ps2_packet __xdata *q = &c->queue[c->head];
+
+                    q->len = c->fill;
+                    q->data[0] = c->packet[0];
+                    q->data[1] = c->packet[1];
+                    q->data[2] = c->packet[2];
+                    q->data[3] = c->packet[3];
+                    c->head = next_head;
+                    busy = 1;
+
+                    /* queue full: hold the device off until there is space */
+                    if( ((unsigned char)(next_head + 1) & (PS2_QUEUE - 1)) == c->tail )
+                    {
+                        PS2_CLK_LOW(ch);
+                        c->inhibit = 1;
+                    }
+                }
+                c->fill = 0;
+            }
+            continue;
+        }
+        c->bitno++;
+    }
+}
+
+
+//! number of replies (including the acknowledge) a mouse command produces
+static unsigned char ps2_replies(unsigned char last_cmd, unsigned char cmd)
+{
+    /* argument bytes of set resolution and set sample rate */
+    if( last_cmd == 0xe8 || last_cmd == 0xf3 )
+        return 1;
+
+    switch( cmd )
+    {
+        case 0xe9: /* status request */
+            return 4;
+        case 0xf2: /* get device id */
+            return 2;
+        case 0xff: /* reset: 0xfa 0xaa 0x00 */
+            return 3;
+        case 0xec: /* reset wrap mode */
+        case 0xee: /* set wrap mode */
+        default:
+            return 1;
+    }
+}
+
+
+//! State machine that passes PS/2 data to the KBC and sends commands
+/*! \return - not zero if there is work to be done.
+ */
+bool handle_ps2(void)
+{
+    unsigned char ch;
+    bool work = 0;
+
+    for( ch = 0; ch < 2; ch++ )
+    {
+        struct ps2_channel __xdata *c = &ps2[ch];
+        unsigned char t;
+        bool off;
+
+        /* whole packets to the host */
+        while( (t = c->tail) != c->head )
+        {
+            if( ch == PS2_TOUCHPAD ?
+                !kbc_put(c->queue[t].data, c->queue[t].len, KBC_STS_AUX) :
+                !kbc_put_keyboard(c->queue[t].data[0]) )
+                break;
+            c->tail = (unsigned char)(t + 1) & (PS2_QUEUE - 1);
+            work = 1;
+        }
+
+        off = (KBCCB & (ch == PS2_TOUCHPAD ? KBC_CB_AUX_OFF : KBC_CB_KBD_OFF)) ? 1 : 0;
+
+        switch( c->state )
+        {
+            case PS2_IDLE:
+                if( c->resend )
+                {
+                    c->tx = 0xfe;
+                    c->host_tx = 0;
+                }
+                else if( ch == PS2_TOUCHPAD && kbc_aux_out_pending )
+                {
+                    c->tx = kbc_aux_out;
+                    c->host_tx = 1;
+                    kbc_aux_out_pending = 0;
+                    PS2_INTERRUPT_DISABLE;
+                    c->expect = ps2_replies(c->last_cmd, c->tx);
+                    if( c->tx == 0xff )
+                        c->size = 3;
+                    c->fill = 0;
+                    PS2_INTERRUPT_ENABLE;
+                    c->last_cmd = c->tx;
+                }
+                else if( ch == PS2_KEYBOARD && kbc_kbd_out_pending )
+                {
+                    /* replies are single bytes like the scan codes */
+                    c->tx = kbc_kbd_out;
+                    c->host_tx = 1;
+                    kbc_kbd_out_pending = 0;
+                    c->last_cmd = c->tx;
+                }
+                else
+                {
+                    /* hold the device off while the host does not
+                       want its data or the queue is full */
+                    PS2_INTERRUPT_DISABLE;
+                    if( off && !c->inhibit )
+                    {
+                        PS2_CLK_LOW(ch);
+                        c->bitno = 0;
+                        c->inhibit = 1;
+                    }
+                    else if( !off && c->inhibit &&
+                             ((unsigned char)(c->head + 1) & (PS2_QUEUE - 1)) != c->tail )
+                    {
+                        PS2_CLK_RELEASE(ch);
+                        c->inhibit = 0;
+                    }
+                    PS2_INTERRUPT_ENABLE;
+                    break;
+                }
+
+                /* request to send. Aborts a frame the device may be sending */
+                PS2_INTERRUPT_DISABLE;
+                c->resend = 0;
+                c->bitno = 0;
+                PS2_CLK_LOW(ch);
+                PS2_INTERRUPT_ENABLE;
+                c->t = (unsigned char)tick;
+                c->state = PS2_RTS;
+                work = 1;
+                break;
+
+            case PS2_RTS:
+                if( (unsigned char)((unsigned char)tick - c->t) < PS2_RTS_TICKS )
+                    break;
+                PS2_INTERRUPT_DISABLE;
+                PS2_DAT_LOW(ch);      /**< start bit */
+                c->ones = 0;
+                c->tx_done = 0;
+                c->tx_bitno = 1;
+                PS2_CLK_RELEASE(ch);
+                c->inhibit = 0;
+                PS2_INTERRUPT_ENABLE;
+                c->t = (unsigned char)tick;
+                c->state = PS2_TX;
+                break;
+
+            case PS2_TX:
+                if( !c->tx_done &&
+                    (unsigned char)((unsigned char)tick - c->t) <= PS2_TX_TICKS )
+                    break;
+
+                PS2_INTERRUPT_DISABLE;
+                if( c->tx_done != PS2_TX_ACK )
+                {
+                    /* no device or no acknowledge */
+                    c->tx_bitno = 0;
+                    c->expect = 0;
+                    c->errors++;
+                    PS2_DAT_RELEASE(ch);
+                }
+                PS2_INTERRUPT_ENABLE;
+
+                /* the host gets a resend for its byte (c->tx is shifted out) */
+                if( c->tx_done != PS2_TX_ACK && c->host_tx )
+                {
+                    static unsigned char __xdata resend = 0xfe;
+                    kbc_put(&resend, 1, ch == PS2_TOUCHPAD ? KBC_STS_AUX : 0);
+                }
+                c->state = PS2_IDLE;
+                work = 1;
+                break;
+        }
+    }
+
+    STATES_UPDATE(touchpad, (ps2[PS2_TOUCHPAD].state << 4) | (ps2[PS2_TOUCHPAD].errors & 0x0f));
+
+    return work;
+}
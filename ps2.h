@@ -0,0 +1,48 @@
+/*-------------------------------------------------------------------------
+   ps2.h - PS/2 keyboard and touchpad pass-through
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include "chip.h"
+
+#define PS2_INTERRUPT_ENABLE  do{ P0IE |=  0x04; } while(0)
+#define PS2_INTERRUPT_DISABLE do{ P0IE &= ~0x04; } while(0)
+
+#define PS2_KEYBOARD (0)   /**< channel numbers, unconfirmed */
+#define PS2_TOUCHPAD (1)
+
+//! received packets per channel waiting for the KBC (power of 2)
+#define PS2_QUEUE (4)
+
+//! a mouse packet, a command reply or a keyboard byte
+struct ps2_packet
+{
+    unsigned char len;
+    unsigned char data[4];
+};
+
+void ps2_init(void);
+
+bool handle_ps2(void);
+
+void ps2_interrupt(void) __interrupt(0x0a);
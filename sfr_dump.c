@@ -159,7 +159,7 @@ static ec_gpio_type __code ec_gpio[] =
 
 
 //! dumps SFR registers and data memory 
-void dump_mcs51( void )
+void dump_mcs51( void ) __banked
 {
     unsigned char i = 0x00;
 
@@ -189,7 +189,7 @@ void dump_mcs51( void )
 
 
 
-void dump_xdata_sfr( void )
+void dump_xdata_sfr( void ) __banked
 {
     unsigned char i,k;
 
@@ -222,7 +222,7 @@ __bit get_bit(volatile unsigned char __xdata *address, unsigned char bitnum)
 }
 
 
-void dump_gpio( void )
+void dump_gpio( void ) __banked
 {
     unsigned char i,k;
 
@@ -313,7 +313,7 @@ void dump_gpio( void )
     to output (and of potentially illegal output combinations
     (if these exist)))
  */
-void gpio_check_IO_direction(void)
+void gpio_check_IO_direction(void) __banked
 {
     #define EC_DUMP_0xFC10_Q2C25_B4 { 0x87, 0xd7, 0xfe, 0x01, 0x0f, 0xbd }
     #define EC_DUMP_0xFC10_Q2C23_B1 { 0x87, 0xd7, 0xfe, 0x01, 0x0b, 0xbd }
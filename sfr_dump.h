@@ -22,7 +22,8 @@
    what you give them.   Help stamp out software-hoarding!
 -------------------------------------------------------------------------*/
 
-void dump_mcs51( void );
-void dump_xdata_sfr( void );
-void dump_gpio( void );
-void gpio_check_IO_direction( void );
+/* these live in the banked code segment, see bank.c */
+void dump_mcs51( void ) __banked;
+void dump_xdata_sfr( void ) __banked;
+void dump_gpio( void ) __banked;
+void gpio_check_IO_direction( void ) __banked;
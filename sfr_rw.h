@@ -27,5 +27,3 @@ unsigned char read_mcs51_sfr(unsigned char address) __naked;
 void write_mcs51_sfr(unsigned char address, unsigned char value) __naked;
 
 void dump_mcs51_sfr( void );
-
-void dump_xdata_sfr( void );
@@ -0,0 +1,219 @@
+/*-------------------------------------------------------------------------
+   soc.c - battery state of charge estimation
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+/*! \file soc.c
+
+   State of charge (SOC) for battery.soc_0x16 (port 0x6c command 0x16).
+
+   Coulomb counting on the DS2756 accumulated charge register (Q_raw)
+   is fused with a lookup of the open circuit voltage (OCV):
+    - the first sample after a battery was found sets the charge
+      from the OCV,
+    - after that Q_raw deltas are integrated,
+    - while the battery rests (small current for a while)
+      the charge is slowly pulled towards the OCV estimate.
+
+   The terminal voltage is corrected for I*R and for temperature
+   before the OCV lookup.
+
+   The OCV tables are coarse guesses and need calibration
+   (NiMH in particular is very flat between 20% and 80%).
+ */
+
+#include <stdbool.h>
+#include "chip.h"
+#include "battery.h"
+#include "charge_sched.h"
+#include "fixmath.h"
+#include "soc.h"
+
+//! nominal capacity in DS2756 accumulated charge counts (0.4167 mAh)
+#define SOC_CAPACITY_COUNTS (9120u)                     /* 3800 mAh, fix */
+
+//! 100/SOC_CAPACITY_COUNTS as fraction for mul_u16_frac()
+#define FRAC_PERCENT_PER_COUNT (0x02ce98b4ul)
+
+//! below this current the battery is considered resting
+#define SOC_REST_CURRENT_mA (40)
+
+//! samples (seconds) of rest until the OCV is trusted
+#define SOC_REST_SAMPLES (120)
+
+//! weight of the OCV estimate while resting is 2^-n per sample
+#define SOC_OCV_BLEND_SHIFT (4)
+
+//! charge per 1/64 mV within a segment of step (4 mV units) for mul_u16_frac()
+/*! (SOC_CAPACITY_COUNTS / 10) / (256 * step) as binary fraction,
+    rounded down. Fits 32 bit for steps from 4 up.
+ */
+#define SOC_FRAC(step) ((0x1000000ul / (step)) * (SOC_CAPACITY_COUNTS / 10))
+
+//! a segment of 10% of an OCV table
+#define SOC_SEGMENT(step) { (step), SOC_FRAC(step) }
+
+//! OCV table of a chemistry. 11 points from 0% to 100%
+/*! The voltages are for the pack at 25 degC.
+    segment[i].step is the increase from point i to point i+1
+    in units of 4 mV.
+ */
+typedef struct
+{
+    unsigned int base_mV;           /**< OCV at 0% */
+    struct
+    {
+        unsigned char step;         /**< 4 mV units, 4 and up */
+        unsigned long frac;         /**< SOC_FRAC(step) */
+    } segment[10];
+    signed char tc_mV_per_10degC;   /**< OCV temperature coefficient */
+} soc_ocv_table_type;
+
+//! NiMH, 5 cells
+static soc_ocv_table_type __code soc_ocv_NiMH =
+{
+    5750,
+    { SOC_SEGMENT(88), SOC_SEGMENT(25), SOC_SEGMENT(12), SOC_SEGMENT(13),
+      SOC_SEGMENT(12), SOC_SEGMENT(13), SOC_SEGMENT(12), SOC_SEGMENT(13),
+      SOC_SEGMENT(25), SOC_SEGMENT(75) },
+    -20
+};
+
+//! LiFePO4, 2 cells
+static soc_ocv_table_type __code soc_ocv_LiFe =
+{
+    5800,
+    { SOC_SEGMENT(150), SOC_SEGMENT(25), SOC_SEGMENT(15), SOC_SEGMENT(10),
+      SOC_SEGMENT(5), SOC_SEGMENT(5), SOC_SEGMENT(5), SOC_SEGMENT(5),
+      SOC_SEGMENT(5), SOC_SEGMENT(50) },
+    -2
+};
+
+static struct
+{
+    unsigned int charge;            /**< in counts, 0..SOC_CAPACITY_COUNTS */
+    unsigned int last_Q_raw;
+    unsigned char rest;
+    bool valid;
+} __xdata soc;
+
+
+//! charge (in counts) that corresponds to the open circuit voltage
+static unsigned int soc_from_ocv(unsigned int u)
+{
+    soc_ocv_table_type __code *p = bat_chem_LiFe ? &soc_ocv_LiFe : &soc_ocv_NiMH;
+    unsigned int v = p->base_mV;
+    unsigned int charge = 0;
+    unsigned char i;
+
+    if( u <= v )
+        return 0;
+
+    for( i = 0; i < sizeof p->segment / sizeof p->segment[0]; i++ )
+    {
+        unsigned char step = p->segment[i].step;
+        unsigned int d = u - v;
+
+        if( d < 4 * step )
+        {
+            /* interpolate within the segment, d << 6 is below 0x10000 */
+            return charge + mul_u16_frac(d << 6, p->segment[i].frac);
+        }
+        v += 4 * step;
+        charge += SOC_CAPACITY_COUNTS / 10;
+    }
+
+    return SOC_CAPACITY_COUNTS;
+}
+
+
+//! terminal voltage of compare_is corrected to an OCV at 25 degC
+static unsigned int soc_ocv_mV(void)
+{
+    soc_ocv_table_type __code *p = bat_chem_LiFe ? &soc_ocv_LiFe : &soc_ocv_NiMH;
+    unsigned int u = compare_is.U_mV;
+    int t;
+
+    /* I*R drop, charging current is positive */
+    u -= mul_s16_frac(compare_is.I_mA, FRAC_0_18);
+
+    /* temperature in whole degrees relative to 25 degC */
+    t = (compare_is.T_cCelsius - 2500) / 100;
+    u -= t * p->tc_mV_per_10degC / 10;
+
+    return u;
+}
+
+
+//! forget the battery (removed or exchanged)
+void soc_reset(void)
+{
+    soc.valid = 0;
+}
+
+
+//! to be called once for every new sample in compare_is
+void soc_update(void)
+{
+    unsigned int ocv_charge = soc_from_ocv( soc_ocv_mV() );
+
+    if( !soc.valid )
+    {
+        soc.charge = ocv_charge;
+        soc.rest = 0;
+        soc.valid = 1;
+    }
+    else
+    {
+        int dq = compare_is.Q_raw - soc.last_Q_raw;
+        int c = soc.charge + dq;
+
+        if( c < 0 )
+            c = 0;
+        else if( c > (int)SOC_CAPACITY_COUNTS )
+            c = SOC_CAPACITY_COUNTS;
+        soc.charge = c;
+
+        if( compare_is.I_mA < SOC_REST_CURRENT_mA &&
+            compare_is.I_mA > -SOC_REST_CURRENT_mA )
+        {
+            if( soc.rest < SOC_REST_SAMPLES )
+                soc.rest++;
+            else
+            {
+                /* rounding towards ocv_charge so it is reached */
+                int e = ocv_charge - soc.charge;
+
+                if( e > 0 )
+                    soc.charge += (e + (1 << SOC_OCV_BLEND_SHIFT) - 1) >> SOC_OCV_BLEND_SHIFT;
+                else
+                    soc.charge -= (-e + (1 << SOC_OCV_BLEND_SHIFT) - 1) >> SOC_OCV_BLEND_SHIFT;
+            }
+        }
+        else
+            soc.rest = 0;
+    }
+
+    soc.last_Q_raw = compare_is.Q_raw;
+
+    battery.soc_0x16 = (unsigned char)mul_u16_frac(soc.charge, FRAC_PERCENT_PER_COUNT);
+}
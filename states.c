@@ -120,8 +120,6 @@ void print_states_ruler (void)
 
 void print_states (void)
 {
-     unsigned char i;
-
      if( !print_states_enable )
          return;
 
@@ -148,17 +146,12 @@ void print_states (void)
      putspace();
      puthex(GPIOEIN0);
      putspace();
-     for(i=0; i<5; i++)
-     {
-         puthex(((unsigned char __pdata *)&cursors)[i]);
-         if( i==2 )
-             putspace();
-     }
-     if( cursors.keycode_updated )
-     {
+     puthex(cursors.game_key_status[1]);
+     puthex(cursors.game_key_status[0]);
+     putspace();
+     puthex((unsigned char)(cursors.head - cursors.tail) & (KEYCODE_FIFO - 1));
+     if( cursors.overflow )
          putchar('*');
-         cursors.keycode_updated = 0;
-     }
 #endif
 
 ow_dump();
@@ -42,72 +42,59 @@
 #include <stdbool.h>
 #include "chip.h"
 #include "adc.h"
+#include "temperature.h"
 #include "uart.h"
 
 
-/* extracting some data of AN817 figure 5 by hand.
-   Just to have something.
+/* The conversion tables are generated at build time from the
+   NTC parameters in the Makefile (NTC_PARAMS), see tools/ntc_table.py.
 
-   I arbitrarily picked the middle curve (Beta = 4100 Kelvin)
-   and coarsly extracted some numbers.
-   (Above 70 degrees and below -20 degrees they will be boguous anyway)
+   The parameters default to the middle curve of AN817 figure 5
+   (Beta = 4100 Kelvin) with R25 equal to the divider resistor,
+   which is what the hand-typed table used to be extracted from.
 
    R363 (the NTC used) most likely is different. What is its Beta?
  */
-#define T_0x00 (110) /* delta <= 16 */
-#define T_0x10 ( 95) /* delta <= 16 */
-#define T_0x20 ( 80) /* delta <= 16 */
-#define T_0x30 ( 65)
-#define T_0x40 ( 53)
-#define T_0x50 ( 46)
-#define T_0x60 ( 40)
-#define T_0x70 ( 32)
-#define T_0x80 ( 25)
-#define T_0x90 ( 20)
-#define T_0xa0 ( 13)
-#define T_0xb0 (  8)
-#define T_0xc0 (  2)
-#define T_0xd0 ( -5)
-#define T_0xe0 (-12)
-#define T_0xf0 (-25)
-#define T_0x100 (-40) /* needed for interpol */
-
-char __code table[16] =
-{
-    T_0x00, T_0x10, T_0x20, T_0x30,
-    T_0x40, T_0x50, T_0x60, T_0x70,
-    T_0x80, T_0x90, T_0xa0, T_0xb0,
-    T_0xc0, T_0xd0, T_0xe0, T_0xf0
-};
 
-char __code table_delta[16] =
+
+//! convert the ADC readout voltage to temperature
+char adc_to_degC(unsigned char c)
 {
-    /* all deltas should be <= 16 (>= -16) */
-    T_0x00 - T_0x10,
-    T_0x10 - T_0x20,
-    T_0x20 - T_0x30,
-    T_0x30 - T_0x40,
+    return ntc_degC[c];
+}
 
-    T_0x40 - T_0x50,
-    T_0x50 - T_0x60,
-    T_0x60 - T_0x70,
-    T_0x70 - T_0x80,
 
-    T_0x80 - T_0x90,
-    T_0x90 - T_0xa0,
-    T_0xa0 - T_0xb0,
-    T_0xb0 - T_0xc0,
+//! convert the sum of ADC_OVERSAMPLE conversions to centi-degC
+/*! The 12 bit value is split into 64 segments. The coarse table
+    gives the temperature at the start of a segment, the fine
+    table the drop within it (fine rows are shared by segments
+    with the same slope). No multiply.
+ */
+int adc_to_centi_degC(unsigned int v)
+{
+    unsigned char k = (v >> 6) & 0x3f;
 
-    T_0xc0 - T_0xd0,
-    T_0xd0 - T_0xe0,
-    T_0xe0 - T_0xf0,
-    T_0xf0 - T_0x100
-};
+    return ntc_centi_coarse[k] -
+           ((unsigned int)ntc_fine[ ntc_fine_row[k] ][ v & 0x3f ] << ntc_fine_shift[k]);
+}
 
 
-//! convert the ADC readout voltage to temperature
-char adc_to_degC(unsigned char c)
+//! lowest 12 bit sum that converts to t_cC or less
+/*! The inverse of adc_to_centi_degC() for setting ADC windows.
+    Binary search, the table falls monotonously. */
+unsigned int adc_from_centi_degC(int t_cC)
 {
-    /* not a generic interpolation routine. Needs monotonously falling values */
-    return table[c >> 4] - (unsigned char)(table_delta[c >> 4] * (c & 0x0f) + 8) / 16;
+    unsigned int lo = 0;
+    unsigned int hi = ADC_OVERSAMPLE * 256;
+
+    while( lo < hi )
+    {
+        unsigned int mid = (lo + hi) / 2;
+
+        if( adc_to_centi_degC( mid ) <= t_cC )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
 }
@@ -1 +1,10 @@
 char adc_to_degC(unsigned char c);
+int adc_to_centi_degC(unsigned int v);
+unsigned int adc_from_centi_degC(int t_cC);
+
+/* generated by tools/ntc_table.py, see Makefile */
+extern signed char __code ntc_degC[256];
+extern int __code ntc_centi_coarse[64];
+extern unsigned char __code ntc_fine_row[64];
+extern unsigned char __code ntc_fine_shift[64];
+extern unsigned char __code ntc_fine[][64];
@@ -58,6 +58,17 @@ static volatile unsigned char __pdata tick_next_s;
 volatile unsigned long __pdata second;
 
 
+#if PROFILE
+//! histogram of the program counter at timer IRQ, 512 byte buckets
+/*! Addresses 0x8000..0xbfff are the banked window (see bank.c),
+    so they count whatever bank was mapped. */
+unsigned int __xdata profile_hits[PROFILE_BUCKETS];
+
+//! main loop passes, counted by main() (and only there)
+unsigned long __xdata profile_passes;
+#endif
+
+
 //! There is no embedded device without a timer, is there?
 /*! different speed if powered down?
     Currently using the 8-bit timer with lowermost priority
@@ -110,7 +121,53 @@ void timer_gpt3_init(void)
     whereever possible and rely on the main loop
     spinning around quickly enough.
  */
+#if PROFILE && defined(SDCC)
+/*! Needs to be naked to find the return address on the stack.
+    The counters do not saturate, read them before 10 minutes
+    of sampling are over. */
+void timer_gpt3_interrupt(void) __interrupt(0x17) __naked
+{
+    __asm
+        push    acc
+        push    psw
+        mov     psw,#0x00
+        push    ar0
+        push    dpl
+        push    dph
+
+        mov     a,sp
+        add     a,#-5           ; high byte of the interrupted PC
+        mov     r0,a
+        mov     a,@r0
+        anl     a,#0xfe         ; 512 byte buckets, 2 bytes each
+        add     a,#<_profile_hits
+        mov     dpl,a
+        clr     a
+        addc    a,#>_profile_hits
+        mov     dph,a
+
+        movx    a,@dptr
+        add     a,#1
+        movx    @dptr,a
+        inc     dptr
+        movx    a,@dptr
+        addc    a,#0
+        movx    @dptr,a
+
+        pop     dph
+        pop     dpl
+        pop     ar0
+        pop     psw
+        pop     acc
+        ljmp    _timer_gpt3_tick
+    __endasm;
+}
+
+//! the timer IRQ proper, entered from the sampling code above
+void timer_gpt3_tick(void) __interrupt
+#else
 void timer_gpt3_interrupt(void) __interrupt(0x17)
+#endif
 {
     /* reset IRQ pending flag 
        is this the way to reset it?
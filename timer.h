@@ -27,6 +27,24 @@
 #define SYSCLOCK (32000000uL)  /**< in Hertz, true? */
 #define GPTCLOCK (32768u)      /**< in Hertz, true? */
 
+//! sample the interrupted program counter in the timer IRQ
+/*! Build mode for profile guided code placement. Read the
+    histogram with the monitor command 'p' and feed it to
+    tools/hotcold.py (see there).
+ */
+#define PROFILE (0)
+
+//! code addresses per histogram bucket is 0x10000 / PROFILE_BUCKETS
+#define PROFILE_BUCKETS (128)
+
+//! ticks the monitor command 'P' counts main loop passes
+#define PROFILE_PASSES_TICKS (10 * HZ)
+
+#if PROFILE
+extern unsigned int __xdata profile_hits[PROFILE_BUCKETS];
+extern unsigned long __xdata profile_passes;
+#endif
+
 extern volatile unsigned int __pdata tick;
 extern volatile unsigned long __pdata second;
 
@@ -0,0 +1,56 @@
+#!/usr/bin/env python
+#
+# blockdump.py - extract the binary block dump of the monitor 'X' command
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# Usage:
+#   blockdump.py capture out.bin
+#
+# capture is the raw UART stream (text before and after the dump is
+# skipped). Frames are:
+#   STX, len, address hi, address lo, len data bytes, checksum
+# with the sum of all bytes after STX being zero. len 0 ends the dump.
+
+import sys
+
+STX = 0x02
+
+
+def extract(data):
+    out = bytearray()
+    start = None
+    i = data.find(bytes([STX]))
+    while 0 <= i and i + 5 <= len(data):
+        n = data[i + 1]
+        frame = data[i + 1:i + 5 + n]
+        if len(frame) < n + 4:
+            sys.exit('truncated frame at offset %d' % i)
+        if sum(frame) & 0xff:
+            sys.exit('checksum error in frame at offset %d' % i)
+        address = frame[1] << 8 | frame[2]
+        if start is None:
+            start = address
+        if n == 0:
+            return start, out
+        out += frame[3:3 + n]
+        i += 5 + n
+        if i >= len(data) or data[i] != STX:
+            sys.exit('frame missing at offset %d' % i)
+    sys.exit('no end of dump found')
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: blockdump.py capture out.bin\n')
+        sys.exit(1)
+    start, out = extract(open(argv[1], 'rb').read())
+    open(argv[2], 'wb').write(out)
+    sys.stderr.write('%d bytes from 0x%04x\n' % (len(out), start if start is not None else 0))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
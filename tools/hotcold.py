@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+#
+# hotcold.py - link order from the program counter histogram
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# Usage:
+#   hotcold.py openec.map capture [capture ...] > hotcold.mk
+#   hotcold.py --passes before after
+#
+# Build with PROFILE set to 1 in timer.h, let the EC run a while
+# and collect the output of the monitor command 'p' (lines
+# "p<address> <hits>", several captures are added up).
+#
+# The EC fetches its code from the SPI flash, every jump out of the
+# prefetched bytes costs a full address setup. So modules with the
+# most samples are linked first (after main.rel and flash.rel), modules
+# without samples last. The Makefile picks up HOT_MODULES from
+# hotcold.mk. Only 0x0000..0x7fff is ordered, code in HOME2 and in
+# the banks (see bank.c) keeps its place.
+#
+# To see what the link order gains, run the monitor command 'P' on a
+# PROFILE build without hotcold.mk and again on one with it (lines
+# "l<ticks> <passes>", the EC does not sleep meanwhile). --passes
+# prints the main loop passes per second of both captures; fewer
+# SPI address setups per pass show up as more passes.
+
+import re
+import sys
+
+BUCKET = 0x200
+MAP_SYMBOL = re.compile(r'^\s*C:\s+([0-9A-Fa-f]+)\s+(\S+)\s+(\S+)\s*$')
+SAMPLE = re.compile(r'p([0-9A-Fa-f]{4}) ([0-9A-Fa-f]{4})')
+PASSES = re.compile(r'l([0-9A-Fa-f]{4}) ([0-9A-Fa-f]{8})')
+HZ = 100
+
+
+def read_map(name):
+    """code symbols below the bank window as sorted (address, symbol, module)"""
+    symbols = []
+    for line in open(name):
+        match = MAP_SYMBOL.match(line)
+        if match:
+            address = int(match.group(1), 16)
+            if address < 0x8000:
+                symbols.append((address, match.group(2), match.group(3)))
+    symbols.sort()
+    return symbols
+
+
+def read_samples(names):
+    hits = {}
+    for name in names:
+        for match in SAMPLE.finditer(open(name).read()):
+            address = int(match.group(1), 16)
+            hits[address] = hits.get(address, 0) + int(match.group(2), 16)
+    return hits
+
+
+def read_passes(name):
+    """main loop passes per second, averaged over the 'P' lines of a capture"""
+    ticks = passes = 0
+    for match in PASSES.finditer(open(name).read()):
+        ticks += int(match.group(1), 16)
+        passes += int(match.group(2), 16)
+    if not ticks:
+        sys.exit('%s: no output of the monitor command P' % name)
+    return float(passes) * HZ / ticks
+
+
+def compare_passes(before, after):
+    a = read_passes(before)
+    b = read_passes(after)
+    print('%-24s %10.0f passes/s' % (before, a))
+    print('%-24s %10.0f passes/s' % (after, b))
+    print('%+.1f%%' % (100.0 * (b - a) / a))
+
+
+def spans(symbols):
+    """(start, end, module) for each function"""
+    result = []
+    for i, (address, symbol, module) in enumerate(symbols):
+        # (the size of the last one is unknown, guess a bucket)
+        end = symbols[i + 1][0] if i + 1 < len(symbols) else address + BUCKET
+        result.append((address, end, module))
+    return result
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == '--passes':
+        compare_passes(sys.argv[2], sys.argv[3])
+        return
+    if len(sys.argv) < 3:
+        sys.exit(__doc__ or 'usage: hotcold.py openec.map capture...')
+
+    functions = spans(read_map(sys.argv[1]))
+    hits = read_samples(sys.argv[2:])
+
+    module_hits = {}
+    module_size = {}
+    module_range = {}
+    for start, end, module in functions:
+        module_size[module] = module_size.get(module, 0) + end - start
+        low, high = module_range.get(module, (start, end))
+        module_range[module] = (min(low, start), max(high, end))
+        module_hits.setdefault(module, 0.0)
+        # share the hits of a bucket by the bytes a function has in it
+        for bucket, n in hits.items():
+            overlap = min(end, bucket + BUCKET) - max(start, bucket)
+            if overlap > 0:
+                module_hits[module] += float(n) * overlap / BUCKET
+
+    total = float(sum(hits.values())) or 1.0
+    hot = sorted((m for m in module_hits if module_hits[m] > 0),
+                 key=lambda m: -module_hits[m] / max(module_size[m], 1))
+    if 'main' in hot:
+        hot.remove('main')
+    hot.insert(0, 'main')
+
+    # footprint of the code that takes 95% of the samples
+    covered = 0.0
+    footprint = []
+    for m in sorted(hot, key=lambda m: -module_hits[m]):
+        if covered >= 0.95 * total:
+            break
+        covered += module_hits[m]
+        footprint.append(m)
+    before = (max(module_range[m][1] for m in footprint) -
+              min(module_range[m][0] for m in footprint)) if footprint else 0
+    after = sum(module_size[m] for m in footprint)
+
+    print('# generated by tools/hotcold.py from %d samples' % int(total))
+    for m in hot:
+        print('#   %-16s %6.1f%% %6d bytes' %
+              (m, 100.0 * module_hits[m] / total, module_size[m]))
+    print('# 95%% of the samples hit code spread over 0x%04x bytes now'
+          % before)
+    print('# and over 0x%04x bytes with this link order' % after)
+    print('HOT_MODULES = %s' % ' '.join(hot))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+#
+# logdecode.py - string table generator and decoder for the
+#                binary debug records of log.h
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# Usage:
+#   logdecode.py --table log.h file.c ... > openec.logtab
+#       collect the format strings of all LOGn() calls
+#
+#   logdecode.py openec.logtab [logfile]
+#       decode a captured UART stream (or stdin) to text
+#
+# The table has one line per LOGn() call:
+#   <id in hex> <number of args> <file>:<line> <format as C string literal>
+#
+# SLOGn() records carry no tick.
+
+import re
+import sys
+
+LOG_RECORD_MARK = 0xf0
+LOG_RECORD_NO_TICK = 0x04
+
+re_module_number = re.compile(r'#define\s+(LOG_MODULE_\w+)\s+\(?\s*(\d+)\s*\)?')
+re_module = re.compile(r'#define\s+LOG_MODULE\s+(\w+|\(\s*\d+\s*\))')
+re_log = re.compile(r'\bS?LOG([0-3])\s*\(\s*"((?:[^"\\]|\\.)*)"')
+re_conv = re.compile(r'%[-+ 0#]*\d*([duxXc%])')
+
+
+def make_table(log_h, sources):
+    modules = {}
+    for line in open(log_h):
+        m = re_module_number.match(line)
+        if m:
+            modules[m.group(1)] = int(m.group(2))
+
+    seen = {}
+    for src in sources:
+        module = None
+        for lineno, line in enumerate(open(src), 1):
+            m = re_module.match(line)
+            if m:
+                name = m.group(1).strip('() ')
+                module = int(name) if name.isdigit() else modules[name]
+                continue
+            m = re_log.search(line)
+            if not m:
+                continue
+            if module is None:
+                sys.exit('%s:%d: LOG%s without LOG_MODULE' % (src, lineno, m.group(1)))
+            if lineno >= 2048:
+                sys.exit('%s:%d: line number does not fit into the id' % (src, lineno))
+            ident = (module << 11) | lineno
+            if ident in seen:
+                sys.exit('%s:%d: id 0x%04x already used by %s' % (src, lineno, ident, seen[ident]))
+            seen[ident] = '%s:%d' % (src, lineno)
+            sys.stdout.write('0x%04x %s %s:%d "%s"\n' %
+                             (ident, m.group(1), src, lineno, m.group(2)))
+
+
+def unescape(s):
+    return s.encode('latin-1').decode('unicode_escape')
+
+
+def load_table(name):
+    table = {}
+    for line in open(name):
+        ident, nargs, where, fmt = line.rstrip('\n').split(' ', 3)
+        table[int(ident, 16)] = (int(nargs), where, unescape(fmt[1:-1]))
+    return table
+
+
+def format_record(table, ident, tick, args):
+    if ident not in table:
+        when = '' if tick is None else ' @%u' % tick
+        return '<log 0x%04x%s: %s>' % (ident, when, ' '.join('%04x' % a for a in args))
+    nargs, where, fmt = table[ident]
+    values = []
+    it = iter(args)
+    for m in re_conv.finditer(fmt):
+        if m.group(1) == '%':
+            continue
+        v = next(it, 0)
+        if m.group(1) == 'd' and v & 0x8000:
+            v -= 0x10000
+        values.append(v)
+    return fmt % tuple(values)
+
+
+def decode(table, stream):
+    out = sys.stdout
+    while True:
+        c = stream.read(1)
+        if not c:
+            break
+        b = ord(c)
+        if b & 0xf8 != LOG_RECORD_MARK:
+            out.write(chr(b))
+            continue
+        n = b & 0x03
+        if b & LOG_RECORD_NO_TICK:
+            size = 2 + 2 * n
+        else:
+            size = 4 + 2 * n
+        raw = bytearray(stream.read(size))
+        if len(raw) < size:
+            break
+        words = [raw[i] | raw[i + 1] << 8 for i in range(0, len(raw), 2)]
+        if b & LOG_RECORD_NO_TICK:
+            out.write(format_record(table, words[0], None, words[1:]))
+        else:
+            out.write(format_record(table, words[0], words[1], words[2:]))
+        out.flush()
+
+
+def main(argv):
+    if len(argv) >= 3 and argv[1] == '--table':
+        make_table(argv[2], argv[3:])
+    elif len(argv) in (2, 3):
+        table = load_table(argv[1])
+        if len(argv) == 3:
+            stream = open(argv[2], 'rb')
+        else:
+            stream = getattr(sys.stdin, 'buffer', sys.stdin)
+        decode(table, stream)
+    else:
+        sys.stderr.write('usage: logdecode.py --table log.h file.c ...\n'
+                         '       logdecode.py openec.logtab [logfile]\n')
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+#
+# mapcheck.py - check the code areas of the linked image
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# Usage:
+#   mapcheck.py openec.map AREA=start:end [_symbol=start:end ...]
+#
+# Fails if a code area of the map file does not lie within
+# start..end-1. '*' stands for every relocatable code area
+# without an entry of its own (the home area, see bank.c).
+# Areas are checked independently by the linker, so an
+# overflow would otherwise silently run into the next one.
+#
+# Names starting with '_' are functions. A function is taken
+# to reach up to the next code symbol (or the end of its area),
+# which can only overestimate its size.
+
+import re
+import sys
+
+MAP_SYMBOL = re.compile(r'^\s*C:\s+([0-9A-Fa-f]+)\s+(\S+)\s+(\S+)\s*$')
+MAP_AREA = re.compile(r'^(\S+)\s+([0-9A-Fa-f]{4,8})\s+([0-9A-Fa-f]{4,8})'
+                      r'\s+=\s+\d+\.\s+bytes\s+\(([^)]*)\)')
+
+
+def read_areas(name):
+    """code areas as (name, start, size)"""
+    areas = []
+    for line in open(name):
+        match = MAP_AREA.match(line)
+        if not match:
+            continue
+        attributes = match.group(4).split(',')
+        if 'CODE' in attributes and 'ABS' not in attributes:
+            areas.append((match.group(1), int(match.group(2), 16),
+                          int(match.group(3), 16)))
+    return areas
+
+
+def read_symbols(name):
+    """code symbols as {symbol: address}"""
+    symbols = {}
+    for line in open(name):
+        match = MAP_SYMBOL.match(line)
+        if match:
+            symbols[match.group(2)] = int(match.group(1), 16)
+    return symbols
+
+
+def symbol_end(address, symbols, areas):
+    """first address behind the function at address"""
+    end = min([start + size for area, start, size in areas
+               if start <= address < start + size] or [address + 1])
+    return min([a for a in symbols.values() if address < a < end] or [end])
+
+
+def read_limits(args):
+    limits = {}
+    for arg in args:
+        area, bounds = arg.split('=')
+        start, end = bounds.split(':')
+        limits[area] = (int(start, 0), int(end, 0))
+    return limits
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('usage: mapcheck.py openec.map AREA=start:end ...')
+
+    limits = read_limits(sys.argv[2:])
+    areas = read_areas(sys.argv[1])
+    symbols = read_symbols(sys.argv[1])
+    failed = False
+    for symbol in [s for s in limits if s.startswith('_')]:
+        low, high = limits.pop(symbol)
+        if symbol not in symbols:
+            print('%s: function %s not found' % (sys.argv[1], symbol))
+            failed = True
+            continue
+        start = symbols[symbol]
+        end = symbol_end(start, symbols, areas)
+        if start < low or end > high:
+            print('%s: function %s at 0x%05x..0x%05x is outside '
+                  '0x%05x..0x%05x' % (sys.argv[1], symbol, start, end - 1,
+                                      low, high - 1))
+            failed = True
+    for area, start, size in areas:
+        if size == 0:
+            continue
+        low, high = limits.get(area, limits.get('*', (start, start + size)))
+        if start < low or start + size > high:
+            print('%s: area %s at 0x%05x..0x%05x is outside 0x%05x..0x%05x'
+                  % (sys.argv[1], area, start, start + size - 1,
+                     low, high - 1))
+            failed = True
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
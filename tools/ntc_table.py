@@ -0,0 +1,122 @@
+#!/usr/bin/env python
+#
+# ntc_table.py - generate the NTC conversion tables (ntc_table.c)
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# Usage:
+#   ntc_table.py [--beta K] [--r25 Ohm] [--divider Ohm]
+#                [--tmin degC] [--tmax degC] [--tolerance centi-degC]
+#                > ntc_table.c
+#
+# The NTC is between the ADC input and ground, the divider resistor
+# between the ADC input and the ADC reference. So the ADC reading
+# falls with rising temperature.
+#
+# Generated tables (see temperature.c for their use):
+#   ntc_degC[256]          degC for the 8 bit reading (adc_cache[])
+#   ntc_centi_coarse[64]   centi-degC at the start of each of the
+#                          64 segments of the 12 bit sum (adc_value[])
+#   ntc_fine_row[64]       row of ntc_fine[] used by a segment
+#   ntc_fine_shift[64]     left shift applied to that row
+#   ntc_fine[rows][64]     drop from ntc_centi_coarse[] within a segment
+# Segments with fine curves within --tolerance share a row.
+
+import math
+import optparse
+
+FULL_8 = 256
+FULL_12 = 4096
+SEGMENT = 64
+
+
+def parse():
+    p = optparse.OptionParser(usage='%prog [options] > ntc_table.c')
+    p.add_option('--beta', type='float', default=4100.0)
+    p.add_option('--r25', type='float', default=10000.0)
+    p.add_option('--divider', type='float', default=10000.0)
+    p.add_option('--tmin', type='float', default=-40.0)
+    p.add_option('--tmax', type='float', default=125.0)
+    p.add_option('--tolerance', type='int', default=10,
+                 help='centi-degC a shared fine row may be off')
+    return p.parse_args()[0]
+
+
+def temperature(opt, ratio):
+    """degC for ADC reading / full scale, clamped to tmin..tmax"""
+    if ratio <= 0.0:
+        return opt.tmax
+    if ratio >= 1.0:
+        return opt.tmin
+    r = opt.divider * ratio / (1.0 - ratio)
+    t = 1.0 / (1.0 / 298.15 + math.log(r / opt.r25) / opt.beta) - 273.15
+    return max(opt.tmin, min(opt.tmax, t))
+
+
+def centi(opt, v):
+    # sum of 16 truncated conversions: add half a LSB of each
+    return int(round(100.0 * temperature(opt, (v + 8.0) / FULL_12)))
+
+
+def rows_for(opt):
+    rows = []
+    row_of = []
+    shift_of = []
+    worst = 0
+    for k in range(FULL_12 // SEGMENT):
+        base = centi(opt, k * SEGMENT)
+        drop = [base - centi(opt, k * SEGMENT + j) for j in range(SEGMENT)]
+        shift = 0
+        while max(drop) >> shift > 255:
+            shift += 1
+        scaled = [(d + (1 << shift >> 1)) >> shift for d in drop]
+        for i, (row, s) in enumerate(rows):
+            if s == shift and max(abs(a - b) for a, b in zip(row, scaled)) << shift <= opt.tolerance:
+                break
+        else:
+            rows.append((scaled, shift))
+            i = len(rows) - 1
+        row, s = rows[i]
+        worst = max([worst] + [abs((a << s) - d) for a, d in zip(row, drop)])
+        row_of.append(i)
+        shift_of.append(shift)
+    return rows, row_of, shift_of, worst
+
+
+def table(values, per_line, width=5):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('    ' + ', '.join('%*d' % (width, v) for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    opt = parse()
+    degC = [int(round(temperature(opt, (c + 0.5) / FULL_8))) for c in range(FULL_8)]
+    coarse = [centi(opt, k * SEGMENT) for k in range(FULL_12 // SEGMENT)]
+    rows, row_of, shift_of, worst = rows_for(opt)
+
+    print('/* ntc_table.c - generated by tools/ntc_table.py, do not edit')
+    print('   Beta %g K, R25 %g Ohm, divider %g Ohm, %g..%g degC' %
+          (opt.beta, opt.r25, opt.divider, opt.tmin, opt.tmax))
+    print('   %d fine rows, off by at most %d centi-degC */' % (len(rows), worst))
+    print('')
+    print('#include <stdbool.h>')
+    print('#include "chip.h"')
+    print('#include "temperature.h"')
+    print('')
+    print('signed char __code ntc_degC[256] =\n{\n%s\n};\n' % table(degC, 16, 4))
+    print('int __code ntc_centi_coarse[64] =\n{\n%s\n};\n' % table(coarse, 8, 6))
+    print('unsigned char __code ntc_fine_row[64] =\n{\n%s\n};\n' % table(row_of, 16, 3))
+    print('unsigned char __code ntc_fine_shift[64] =\n{\n%s\n};\n' % table(shift_of, 16, 3))
+    print('unsigned char __code ntc_fine[%d][64] =\n{' % len(rows))
+    for row, shift in rows:
+        print('    {\n%s\n    },' % table(row, 16, 3).replace('\n    ', '\n        ').replace('    ', '        ', 1))
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,137 @@
+/*-------------------------------------------------------------------------
+   trace.c - post-mortem event trace
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+
+   As a special exception, you may use this file as part of a free software
+   library for the XO of the One Laptop per Child project without restriction.
+   Specifically, if other files instantiate
+   templates or use macros or inline functions from this file, or you compile
+   this file and link it with other files to produce an executable, this
+   file does not by itself cause the resulting executable to be covered by
+   the GNU General Public License.  This exception does not however
+   invalidate any other reasons why the executable file might be covered by
+   the GNU General Public License.
+-------------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include "chip.h"
+#include "states.h"
+#include "timer.h"
+#include "trace.h"
+#include "uart.h"
+
+//! a small ring of timestamped events which survives a watchdog reset
+/*! states/old_states give the last state of each state machine,
+    this gives the events that led there.
+
+    After a reset the newest TRACE_KEEP entries of the previous
+    run are protected against being overwritten until they were
+    dumped. Meanwhile new events use the remaining entries, events
+    that do not fit are counted in trace_header.lost.
+ */
+struct trace_header_type __xdata __at (0xfa78) trace_header;
+struct trace_entry_type __xdata __at (0xfa80) trace_ring[TRACE_ENTRIES];
+
+//! last value per state machine, \see trace_state()
+static unsigned char __pdata trace_last[8];
+
+//! to be called first thing after reset (before states are saved)
+void trace_init(void)
+{
+    unsigned char i;
+
+    if( trace_header.magic != TRACE_MAGIC ||
+        trace_header.head >= TRACE_ENTRIES )
+    {
+        /* power up, XRAM content is random */
+        for( i = 0; i < TRACE_ENTRIES; i++ )
+            trace_ring[i].type = 0;
+
+        trace_header.magic = TRACE_MAGIC;
+        trace_header.head = 0;
+        trace_header.lost = 0;
+        trace_header.boots = 0;
+        trace_header.stop = TRACE_NO_STOP;
+    }
+    else
+    {
+        /* keep what led to the reset */
+        trace_header.stop = (unsigned char)(trace_header.head - TRACE_KEEP) & (TRACE_ENTRIES - 1);
+        trace_header.boots++;
+    }
+
+    TRACE_IRQ(TRACE_BOOT, states.watchdog);
+}
+
+//! add an event to the trace (main loop)
+void trace_event(unsigned char type, unsigned char value)
+{
+    bool ea = EA;
+
+    EA = 0;
+    TRACE_IRQ(type, value);
+    EA = ea;
+}
+
+//! add a state machine transition to the trace (main loop)
+/*! only changes are recorded, so this can be called on each pass */
+void trace_state(unsigned char type, unsigned char value)
+{
+    if( trace_last[type & 0x07] == value )
+        return;
+
+    trace_last[type & 0x07] = value;
+    trace_event(type, value);
+}
+
+//! allow the entries of the previous run to be overwritten
+void trace_release(void)
+{
+    trace_header.stop = TRACE_NO_STOP;
+}
+
+//! print the trace oldest entry first and release it
+void trace_dump(void)
+{
+    unsigned char i = trace_header.head;
+
+    putstring("\r\ntrace boots:");
+    puthex(trace_header.boots);
+    putstring(" lost:");
+    puthex(trace_header.lost);
+
+    do
+    {
+        if( trace_ring[i].type )
+        {
+            putcrlf();
+            puthex_u16(trace_ring[i].tick);
+            putspace();
+            puthex(trace_ring[i].type);
+            putspace();
+            puthex(trace_ring[i].value);
+        }
+        i = (unsigned char)(i + 1) & (TRACE_ENTRIES - 1);
+    } while( i != trace_header.head );
+
+    trace_release();
+}
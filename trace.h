@@ -0,0 +1,101 @@
+/*-------------------------------------------------------------------------
+   trace.h - post-mortem event trace
+
+   Copyright (C) 2007  
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 2, or (at your option) any
+   later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   In other words, you are welcome to use, share and improve this program.
+   You are forbidden to forbid anyone else to use, share and improve
+   what you give them.   Help stamp out software-hoarding!
+-------------------------------------------------------------------------*/
+
+#include "timer.h"
+
+//! number of entries in the trace ring (power of 2)
+#define TRACE_ENTRIES (64)
+
+//! entries of the previous run protected after a reset
+/*! until they were dumped (monitor 'T' or port 0x6c command 0x41) */
+#define TRACE_KEEP (48)
+
+#define TRACE_MAGIC   (0x7ace)
+#define TRACE_NO_STOP (0xff)
+
+/* state machine transitions, \see trace_state() */
+#define TRACE_POWER        (0x01)
+#define TRACE_BATTERY      (0x02)
+#define TRACE_DS2756       (0x03)
+#define TRACE_CHARGE_SCHED (0x04)
+#define TRACE_OW_ERROR     (0x05)   /**< data_ds2756.error */
+
+/* events */
+#define TRACE_BOOT         (0x10)   /**< value is states.watchdog of the previous run */
+#define TRACE_HOST_COMMAND (0x11)
+#define TRACE_WATCHDOG     (0x12)   /**< value is watchdog_all_up_and_well */
+#define TRACE_FLASH_CLOCK  (0x13)   /**< value is flash_clock.state */
+
+struct trace_entry_type {
+    unsigned int tick;
+    unsigned char type;              /**< 0 for an unused entry */
+    unsigned char value;
+};
+
+struct trace_header_type {
+    unsigned int magic;
+    unsigned char head;              /**< next entry to write */
+    unsigned char stop;              /**< first kept entry or TRACE_NO_STOP */
+    unsigned char lost;              /**< events dropped while entries were kept */
+    unsigned char boots;             /**< resets without loss of XRAM */
+    unsigned char reserved[2];
+};
+
+//! the trace ring is not cleared on startup
+/*! It lives in the preserved area just below old_states
+    (and above flash_clock),
+    the linker is told not to place variables there
+    (--xram-size in the Makefile).
+ */
+extern struct trace_header_type __xdata __at (0xfa78) trace_header;
+extern struct trace_entry_type __xdata __at (0xfa80) trace_ring[TRACE_ENTRIES];
+
+//! add an event to the trace from within an IRQ
+/*! No subroutine call, the caller has to make sure it is
+    not interrupted by another writer (main loop uses trace_event()).
+    tick is read unprotected here.
+ */
+#define TRACE_IRQ(t, v) \
+    do \
+    { \
+        unsigned char trace_i = trace_header.head; \
+        if( trace_i == trace_header.stop ) \
+        { \
+            if( !++trace_header.lost ) \
+                trace_header.lost--; \
+        } \
+        else \
+        { \
+            trace_header.head = (unsigned char)(trace_i + 1) & (TRACE_ENTRIES - 1); \
+            trace_ring[trace_i].tick = tick; \
+            trace_ring[trace_i].type = (t); \
+            trace_ring[trace_i].value = (v); \
+        } \
+    } while(0)
+
+void trace_init(void);
+void trace_event(unsigned char type, unsigned char value);
+void trace_state(unsigned char type, unsigned char value);
+void trace_release(void);
+void trace_dump(void);
@@ -123,6 +123,23 @@ static volatile unsigned char __pdata tx_tail;
 
 static volatile bool tx_active;
 
+//! number of entries in the TX descriptor queue
+#define TX_DESC_NUM (8)
+
+//! "emit len bytes from code address p"
+/*! The descriptor is emitted by the ISR once the bytes that were
+    in tx_buffer when it was queued have been sent, i.e. when
+    tx_tail has reached "at". So literal bytes and strings
+    keep their order. */
+static struct {
+    unsigned char __code *p;
+    unsigned char len;
+    unsigned char at;
+} __pdata tx_desc[TX_DESC_NUM];
+
+static          unsigned char __pdata tx_desc_head;
+static volatile unsigned char __pdata tx_desc_tail;
+
 
 void putchar(unsigned char c)
 {
@@ -188,10 +205,19 @@ void uart_interrupt(void) __interrupt(4)
     if( TI )
     {
         unsigned char next_tx_tail;
+        unsigned char d;
 
         TI = 0;
         next_tx_tail = tx_tail;
-        if( next_tx_tail == tx_head )
+        d = tx_desc_tail;
+        if( d != tx_desc_head && tx_desc[d].at == next_tx_tail )
+        {
+            /* a string from code memory is due */
+            SBUF = *tx_desc[d].p++;
+            if( !--tx_desc[d].len )
+                tx_desc_tail = (unsigned char)(d + 1) % TX_DESC_NUM;
+        }
+        else if( next_tx_tail == tx_head )
             tx_active = 0;
         else
         {
@@ -202,6 +228,67 @@ void uart_interrupt(void) __interrupt(4)
     }
 }
 
+//! queue a string from code memory for output
+/*! Only a descriptor is queued, the ISR reads the string itself.
+    So this does not busy wait unless the descriptor queue is full
+    (it then falls back to putchar()).
+    \return length of the string (for padding output)
+ */
+unsigned char putstring(unsigned char __code *p)
+{
+    unsigned char total = 0;
+
+    while( *p )
+    {
+        unsigned char __code *s = p;
+        unsigned char len = 0;
+        unsigned char next_desc_head;
+
+        /* strings longer than 255 are queued in parts */
+        while( *s && len != 0xff )
+        {
+            s++;
+            len++;
+        }
+        total += len;
+
+        next_desc_head = (unsigned char)(tx_desc_head + 1) % TX_DESC_NUM;
+        if( next_desc_head == tx_desc_tail )
+        {
+            /* descriptor queue full. Wait on the bytes instead */
+            do
+                putchar(*p++);
+            while( --len );
+            continue;
+        }
+
+        ES = 0;
+
+        tx_desc[tx_desc_head].p = p;
+        tx_desc[tx_desc_head].len = len;
+        tx_desc[tx_desc_head].at = tx_head;
+        tx_desc_head = next_desc_head;
+
+        if( !tx_active )
+        {
+            tx_active = 1;
+            TI = 1;      /**< start TX interrupt chain */
+        }
+
+        ES = 1;
+
+        p = s;
+    }
+
+    return total;
+}
+
+//! number of bytes putchar() can take without busy waiting
+unsigned char tx_space( void )
+{
+    return (unsigned char)(tx_tail - tx_head - 1) % sizeof tx_buffer;
+}
+
 bool char_avail( void )
 {
     return rx_tail ^ rx_head;
@@ -242,6 +329,7 @@ void uart_init()
     ES = 0;
     rx_tail = rx_head;
     tx_head = tx_tail;
+    tx_desc_head = tx_desc_tail;
     ES = 1;
 }
 
@@ -264,6 +352,11 @@ void tx_drain( void )
 {
 }
 
+unsigned char tx_space( void )
+{
+    return 0xff;
+}
+
 #endif
 
 
@@ -293,6 +386,7 @@ void putcrlf()
     putchar('\n');
 }
 
+#if BITBANG || !defined(SDCC)
 unsigned char putstring(unsigned char __code *p)
 {
     unsigned char c;
@@ -305,4 +399,5 @@ unsigned char putstring(unsigned char __code *p)
     }
     return len;
 }
+#endif
 
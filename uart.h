@@ -29,6 +29,7 @@ void putchar(unsigned char c);
 char getchar();
 bool char_avail( void );
 void tx_drain( void );
+unsigned char tx_space( void );
 
 void uart_init();
 
@@ -72,8 +72,8 @@ UNUSED_IRQ(n_a_0x3b_interrupt,  0x07)
 
 //UNUSED_IRQ(watchdog_interrupt, 0x08)
 UNUSED_IRQ(n_a_0x4b_interrupt,  0x09)
-UNUSED_IRQ(ps2_interrupt,       0x0a)
-UNUSED_IRQ(kbc_interrupt,       0x0b)
+//UNUSED_IRQ(ps2_interrupt,     0x0a)
+//UNUSED_IRQ(kbc_interrupt,     0x0b)
 UNUSED_IRQ(rsv_0x63_interrupt,  0x0c)
 UNUSED_IRQ(lpc_interrupt,       0x0d)
 //UNUSED_IRQ(ec_hi_interrupt,   0x0e)
@@ -91,7 +91,7 @@ UNUSED_IRQ(gpt2_interrupt,      0x16)
 UNUSED_IRQ(extwio_port80_interrupt, 0x18)
 UNUSED_IRQ(gpio00_0f_interrupt, 0x19)
 UNUSED_IRQ(gpio10_1b_interrupt, 0x1a)
-UNUSED_IRQ(rsv_0xdb_interrupt,  0x1b)
+//UNUSED_IRQ(keypad_interrupt,  0x1b)  /* unconfirmed */
 UNUSED_IRQ(rsv_0xe3_interrupt,  0x1c)
 UNUSED_IRQ(rsv_0xeb_interrupt,  0x1d)
 UNUSED_IRQ(rsv_0xf3_interrupt,  0x1e)
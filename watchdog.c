@@ -33,9 +33,11 @@
 -------------------------------------------------------------------------*/
 #include <stdbool.h>
 #include "chip.h"
+#include "flash.h"
 #include "reset.h"
 #include "states.h"
 #include "timer.h"
+#include "trace.h"
 #include "watchdog.h"
 
 //! This is periodically reset. Subsystems should set their bit if they feel fine.
@@ -73,16 +75,18 @@ void watchdog_init(void)
 
 
 
-//! hopefully unused
-/*! This interrupt is _not_ used to calm the watchdog again.
-    Instead, if the IRQ was triggered, it reboots gracefully.
- */
-void watchdog_interrupt(void) __interrupt(0x08)
-{
-    #define WATCHDOG_INTERRUPT_STACK_FOOTPRINT (7)
+//! program counter the watchdog IRQ interrupted, see watchdog_interrupt()
+static unsigned int __data watchdog_pc;
 
-    EA = 0;
 
+//! the part of the watchdog IRQ written in C
+/*! Jumped to by watchdog_interrupt() with EA cleared, never returns.
+    Registers need not be saved as the interrupted code is not
+    resumed, so what is done here does not change where the
+    program counter is found.
+ */
+void watchdog_bite(void)
+{
     /* note that we came here and why we came here. */
     STATES_UPDATE(watchdog, watchdog_all_up_and_well | WATCHDOG_IRQ_OCCURED);
 
@@ -91,20 +95,20 @@ void watchdog_interrupt(void) __interrupt(0x08)
      */
     states.timestamp = tick;
 
-    /* note where we came from. Reads the return address from stack.
-     */
-    {
-        unsigned char p = SP - WATCHDOG_INTERRUPT_STACK_FOOTPRINT - 1;
-        
-        /* note, this information survives a reboot! 
-           \see states.c and \see old_states for details.
-           This means that in case of a watchdog reboot
-           the program counter where the watchdog event 
-           happened is known. And the corresponding line of
-           the C-source can be found by looking into 
-           the .rst (relocated lst) files. */
-        states.watchdog_programcounter = *(unsigned int __idata *) p;
-    }
+    /* note, this information survives a reboot! 
+       \see states.c and \see old_states for details.
+       This means that in case of a watchdog reboot
+       the program counter where the watchdog event 
+       happened is known. And the corresponding line of
+       the C-source can be found by looking into 
+       the .rst (relocated lst) files. */
+    states.watchdog_programcounter = watchdog_pc;
+
+    TRACE_IRQ(TRACE_WATCHDOG, watchdog_all_up_and_well);
+
+    /* the fast SPI clock is suspect, do not use it again */
+    if( flash_clock.state == FLASH_CLOCK_FAST )
+        flash_clock.state = FLASH_CLOCK_FAILED;
 
     /* reset pending flag? */
     P0IF &= ~0x01;
@@ -133,3 +137,25 @@ void watchdog_interrupt(void) __interrupt(0x08)
     __endasm;
 #endif
 }
+
+
+//! hopefully unused
+/*! This interrupt is _not_ used to calm the watchdog again.
+    Instead, if the IRQ was triggered, it reboots gracefully.
+    __naked, so there is no prologue and the return address
+    (the interrupted program counter) is on top of the stack.
+    It is read before any C code runs, see watchdog_bite().
+ */
+void watchdog_interrupt(void) __interrupt(0x08) __naked
+{
+#if defined( SDCC )
+    __asm
+        clr   EA
+        mov   r0,sp
+        mov   _watchdog_pc+1,@r0    ; high byte pushed last
+        dec   r0
+        mov   _watchdog_pc,@r0
+        ljmp  _watchdog_bite
+    __endasm;
+#endif
+}